@@ -0,0 +1,407 @@
+#include "automarkers.h"
+#include "iowave.h"
+#include "fileio.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AUTO_MARKERS_X86
+#endif
+
+namespace
+{
+
+// Loudest sample of count, in the units of the sample type. Integers are returned as their magnitude
+using PeakKernel = float (*)(const uint8_t* samples, size_t count);
+
+int32_t decodeSample(PcmSampleType type, const uint8_t* p)
+{
+    switch (type)
+    {
+    case PcmSampleType::Int16:
+        return (int16_t)(p[0] | (p[1] << 8));
+    case PcmSampleType::Int24:
+        return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) >> 8;
+    default:
+        return (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+    }
+}
+
+float sampleMagnitude(PcmSampleType type, const uint8_t* p)
+{
+    if (type == PcmSampleType::Float32)
+    {
+        uint32_t bits = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return std::fabs(value);
+    }
+    return std::fabs((float)decodeSample(type, p));
+}
+
+template <PcmSampleType type, size_t sampleSize>
+float scalarPeak(const uint8_t* samples, size_t count)
+{
+    float peak = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        peak = std::max(peak, sampleMagnitude(type, samples + i * sampleSize));
+    }
+    return peak;
+}
+
+#ifdef AUTO_MARKERS_X86
+
+// The magnitude of the smallest integer doesn't fit its type, taken as unsigned it's still the largest one
+
+__attribute__((target("avx2")))
+float avx2PeakInt16(const uint8_t* samples, size_t count)
+{
+    __m256i peak = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(samples + i * 2));
+        peak = _mm256_max_epu16(peak, _mm256_abs_epi16(v));
+    }
+
+    uint16_t lanes[16];
+    _mm256_storeu_si256((__m256i*)lanes, peak);
+    float result = scalarPeak<PcmSampleType::Int16, 2>(samples + i * 2, count - i);
+    for (uint16_t lane: lanes)
+    {
+        result = std::max(result, (float)lane);
+    }
+    return result;
+}
+
+__attribute__((target("avx2")))
+float avx2PeakInt32(const uint8_t* samples, size_t count)
+{
+    __m256i peak = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(samples + i * 4));
+        peak = _mm256_max_epu32(peak, _mm256_abs_epi32(v));
+    }
+
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, peak);
+    float result = scalarPeak<PcmSampleType::Int32, 4>(samples + i * 4, count - i);
+    for (uint32_t lane: lanes)
+    {
+        result = std::max(result, (float)lane);
+    }
+    return result;
+}
+
+__attribute__((target("avx2")))
+float avx2PeakFloat32(const uint8_t* samples, size_t count)
+{
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    __m256 peak = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 v = _mm256_loadu_ps((const float*)(samples + i * 4));
+        peak = _mm256_max_ps(peak, _mm256_andnot_ps(signMask, v));
+    }
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, peak);
+    float result = scalarPeak<PcmSampleType::Float32, 4>(samples + i * 4, count - i);
+    for (float lane: lanes)
+    {
+        result = std::max(result, lane);
+    }
+    return result;
+}
+
+__attribute__((target("sse4.1")))
+float ssePeakInt16(const uint8_t* samples, size_t count)
+{
+    __m128i peak = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(samples + i * 2));
+        peak = _mm_max_epu16(peak, _mm_abs_epi16(v));
+    }
+
+    uint16_t lanes[8];
+    _mm_storeu_si128((__m128i*)lanes, peak);
+    float result = scalarPeak<PcmSampleType::Int16, 2>(samples + i * 2, count - i);
+    for (uint16_t lane: lanes)
+    {
+        result = std::max(result, (float)lane);
+    }
+    return result;
+}
+
+__attribute__((target("sse4.1")))
+float ssePeakInt32(const uint8_t* samples, size_t count)
+{
+    __m128i peak = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(samples + i * 4));
+        peak = _mm_max_epu32(peak, _mm_abs_epi32(v));
+    }
+
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, peak);
+    float result = scalarPeak<PcmSampleType::Int32, 4>(samples + i * 4, count - i);
+    for (uint32_t lane: lanes)
+    {
+        result = std::max(result, (float)lane);
+    }
+    return result;
+}
+
+__attribute__((target("sse4.1")))
+float ssePeakFloat32(const uint8_t* samples, size_t count)
+{
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 peak = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 v = _mm_loadu_ps((const float*)(samples + i * 4));
+        peak = _mm_max_ps(peak, _mm_andnot_ps(signMask, v));
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, peak);
+    float result = scalarPeak<PcmSampleType::Float32, 4>(samples + i * 4, count - i);
+    for (float lane: lanes)
+    {
+        result = std::max(result, lane);
+    }
+    return result;
+}
+
+#endif
+
+// The fastest kernel the CPU runs. 24 bit samples don't line up with vector lanes and always take the scalar one
+PeakKernel selectKernel(PcmSampleType type)
+{
+#ifdef AUTO_MARKERS_X86
+    if (__builtin_cpu_supports("avx2"))
+    {
+        switch (type)
+        {
+        case PcmSampleType::Int16: return avx2PeakInt16;
+        case PcmSampleType::Int32: return avx2PeakInt32;
+        case PcmSampleType::Float32: return avx2PeakFloat32;
+        default: break;
+        }
+    }
+    else if (__builtin_cpu_supports("sse4.1"))
+    {
+        switch (type)
+        {
+        case PcmSampleType::Int16: return ssePeakInt16;
+        case PcmSampleType::Int32: return ssePeakInt32;
+        case PcmSampleType::Float32: return ssePeakFloat32;
+        default: break;
+        }
+    }
+#endif
+
+    switch (type)
+    {
+    case PcmSampleType::Int16: return scalarPeak<PcmSampleType::Int16, 2>;
+    case PcmSampleType::Int24: return scalarPeak<PcmSampleType::Int24, 3>;
+    case PcmSampleType::Int32: return scalarPeak<PcmSampleType::Int32, 4>;
+    default: return scalarPeak<PcmSampleType::Float32, 4>;
+    }
+}
+
+}
+
+bool AutoMarkerScanner::init(const IOWave& ioObj, const AutoMarkerSettings& settings)
+{
+    const FormatChunkData* format = ioObj.getFormat();
+    const ChunkData* dataChunk = ioObj.findChunk("data"_cc);
+
+    if (!format || !dataChunk || !dataChunk->getSourceLocation())
+    {
+        std::cerr << "There's no audio data to find markers in" << std::endl;
+        return false;
+    }
+
+    uint16_t code = format->getSampleFormatCode();
+    uint16_t channels = format->getNumberOfChannels();
+    m_sampleSize = channels > 0 ? format->getBlockAlign() / channels : 0;
+
+    if (code == 1 && m_sampleSize == 2) {
+        m_type = PcmSampleType::Int16;
+    } else if (code == 1 && m_sampleSize == 3) {
+        m_type = PcmSampleType::Int24;
+    } else if (code == 1 && m_sampleSize == 4) {
+        m_type = PcmSampleType::Int32;
+    } else if (code == 3 && m_sampleSize == 4) {
+        m_type = PcmSampleType::Float32;
+    } else {
+        std::cerr << "Markers can only be found in 16, 24 or 32 bit integer or 32 bit float PCM data" << std::endl;
+        return false;
+    }
+
+    // The threshold in the units of the samples, so the windows are compared without converting them
+    double fullScale = m_type == PcmSampleType::Float32 ? 1.0 : std::ldexp(1.0, m_sampleSize * 8 - 1);
+    m_threshold = (float)(fullScale * std::pow(10.0, settings.silenceThresholdDb / 20));
+
+    m_kernel = selectKernel(m_type);
+    m_blockAlign = format->getBlockAlign();
+    m_windowFrames = std::max<uint32_t>(1, format->getSampleRate() / windowsPerSecond);
+    m_minSilentWindows = (uint64_t)std::ceil(settings.minSilenceSeconds * windowsPerSecond);
+    m_data = *dataChunk->getSourceLocation();
+
+    // The file starts in silence, so its first sound gets a marker too
+    m_silentWindows = m_minSilentWindows;
+    m_frame = 0;
+    m_pending.clear();
+    m_markers.clear();
+    return true;
+}
+
+void AutoMarkerScanner::scan(const uint8_t* data, size_t size)
+{
+    // A window split between two pieces is put together first
+    if (!m_pending.empty())
+    {
+        size_t count = std::min(size, windowSize() - m_pending.size());
+        m_pending.insert(m_pending.end(), data, data + count);
+        data += count;
+        size -= count;
+
+        if (m_pending.size() < windowSize())
+        {
+            return;
+        }
+        scanWindow(m_pending.data(), m_pending.size());
+        m_pending.clear();
+    }
+
+    size_t whole = size - size % windowSize();
+    for (size_t offset = 0; offset < whole; offset += windowSize())
+    {
+        scanWindow(data + offset, windowSize());
+    }
+    m_pending.assign(data + whole, data + size);
+}
+
+void AutoMarkerScanner::addMarkers(IOWave& ioObj)
+{
+    // The last window is shorter, a trailing partial frame isn't looked at
+    if (!m_pending.empty())
+    {
+        scanWindow(m_pending.data(), m_pending.size() - m_pending.size() % m_blockAlign);
+        m_pending.clear();
+    }
+    ioObj.addMarkers(m_markers, MarkerMerging::MergeWithExisting);
+}
+
+void AutoMarkerScanner::scanWindow(const uint8_t* window, size_t size)
+{
+    size_t sampleCount = size / m_sampleSize;
+    if (sampleCount == 0)
+    {
+        return;
+    }
+
+    if (m_kernel(window, sampleCount) <= m_threshold)
+    {
+        m_silentWindows++;
+        m_frame += size / m_blockAlign;
+        return;
+    }
+
+    if (m_silentWindows >= m_minSilentWindows)
+    {
+        // Only the windows where the sound starts are looked at sample by sample
+        size_t first = 0;
+        while (first + 1 < sampleCount && sampleMagnitude(m_type, window + first * m_sampleSize) <= m_threshold)
+        {
+            first++;
+        }
+
+        // Cue points can't refer to frames past 32 bits
+        uint64_t frame = m_frame + first * m_sampleSize / m_blockAlign;
+        if (frame <= UINT32_MAX)
+        {
+            m_markers.push_back(Marker{(uint32_t)frame, "sound " + std::to_string(m_markers.size() + 1)});
+        }
+    }
+    m_silentWindows = 0;
+    m_frame += size / m_blockAlign;
+}
+
+bool addAutoMarkers(IOWave& ioObj, const char* sourcePath, const AutoMarkerSettings& settings)
+{
+    AutoMarkerScanner scanner;
+    if (!scanner.init(ioObj, settings))
+    {
+        return false;
+    }
+
+    const ChunkLocation& data = scanner.getDataLocation();
+    int fd = open(sourcePath, O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Can't open the specified file \"" << sourcePath << "\"" << std::endl;
+        return false;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, data.startOffset, data.size, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    constexpr size_t readSize = 4 * 1024 * 1024;
+    std::vector<uint8_t> buffer(std::min<uint64_t>(readSize, data.size));
+
+    for (uint64_t offset = 0; offset < data.size; )
+    {
+        size_t size = std::min<uint64_t>(buffer.size(), data.size - offset);
+        if (!readAll(fd, buffer.data(), size, data.startOffset + offset))
+        {
+            std::cerr << "Error reading the audio data of \"" << sourcePath << "\"" << std::endl;
+            close(fd);
+            return false;
+        }
+        scanner.scan(buffer.data(), size);
+        offset += size;
+    }
+    close(fd);
+
+    scanner.addMarkers(ioObj);
+    return true;
+}
+
+bool addAutoMarkers(IOWave& ioObj, const uint8_t* source, size_t sourceSize, const AutoMarkerSettings& settings)
+{
+    AutoMarkerScanner scanner;
+    if (!scanner.init(ioObj, settings))
+    {
+        return false;
+    }
+
+    const ChunkLocation& data = scanner.getDataLocation();
+    if (data.startOffset > sourceSize || data.size > sourceSize - data.startOffset)
+    {
+        std::cerr << "Chunk \"data\" is outside of the source file" << std::endl;
+        return false;
+    }
+
+    scanner.scan(source + data.startOffset, data.size);
+    scanner.addMarkers(ioObj);
+    return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <inttypes.h>
+#include <vector>
+
+#include "markers.h"
+#include "wavdata.h"
+
+class IOWave;
+
+enum class PcmSampleType {
+    Int16,
+    Int24,
+    Int32,
+    Float32
+};
+
+struct AutoMarkerSettings {
+    double silenceThresholdDb{-50.0};   // a window without a sample louder than this, relative to full scale, is silent
+    double minSilenceSeconds{0.5};      // shorter pauses don't start a new region
+};
+
+// Finds where the sound starts after a silence, and the first sound of the file, in audio data that is handed over
+// in order, in pieces of any size. The data is looked at in windows of 10 ms for their loudest sample, with AVX2 or
+// SSE kernels where the CPU has them, for 16, 24 and 32 bit integer and 32 bit float PCM
+class AutoMarkerScanner
+{
+public:
+    static constexpr uint32_t windowsPerSecond = 100;
+
+    // For the format and the data chunk of the loaded file, false if there's nothing it can scan
+    bool init(const IOWave& ioObj, const AutoMarkerSettings& settings);
+
+    // Where the audio data is in the source of the loaded file
+    const ChunkLocation& getDataLocation() const { return m_data; }
+
+    void scan(const uint8_t* data, size_t size);
+
+    // After the last piece: adds a cue point labeled "sound <n>" for each start found
+    void addMarkers(IOWave& ioObj);
+
+private:
+    using PeakKernel = float (*)(const uint8_t* samples, size_t count);
+
+    size_t windowSize() const { return (size_t)m_windowFrames * m_blockAlign; }
+    void scanWindow(const uint8_t* window, size_t size);
+
+    PcmSampleType m_type{PcmSampleType::Int16};
+    PeakKernel m_kernel{nullptr};
+    size_t m_sampleSize{0};
+    size_t m_blockAlign{0};
+    uint32_t m_windowFrames{0};
+    float m_threshold{0};
+    uint64_t m_minSilentWindows{0};
+    uint64_t m_silentWindows{0};
+    uint64_t m_frame{0};
+    ChunkLocation m_data;
+    std::vector<uint8_t> m_pending;     // the start of a window that continues in the next piece
+    std::vector<Marker> m_markers;
+};
+
+// Adds a cue point labeled "sound <n>" wherever the sound starts after a silence, and at the first sound of the file.
+// The samples are read with an AutoMarkerScanner from the source file of the loaded one, at the location of its data chunk
+bool addAutoMarkers(IOWave& ioObj, const char* sourcePath, const AutoMarkerSettings& settings);
+
+// Same for a file that was loaded from memory
+bool addAutoMarkers(IOWave& ioObj, const uint8_t* source, size_t sourceSize, const AutoMarkerSettings& settings);
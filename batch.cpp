@@ -0,0 +1,504 @@
+#include "batch.h"
+#include "patcher.h"
+#include "workstealingpool.h"
+#include "ioengine.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <cctype>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    bool isWaveFile(const fs::path& path)
+    {
+        std::string ext = path.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        return ext == ".wav";
+    }
+
+    uint64_t fileSize(const std::string& path)
+    {
+        std::error_code ec;
+        uint64_t size = fs::file_size(path, ec);
+        return ec ? 0 : size;
+    }
+}
+
+bool readBatchManifest(const char *manifestPath, std::vector<BatchJob> &jobs)
+{
+    std::ifstream manifest(manifestPath);
+
+    if (!manifest.is_open())
+    {
+        std::cerr << "Can't open the manifest \"" << manifestPath << "\"" << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(manifest, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        if (line.empty())
+        {
+            continue;
+        }
+
+        size_t tabIndex = line.find('\t');
+        if (tabIndex == std::string::npos)
+        {
+            jobs.push_back(BatchJob{line, std::string()});
+        }
+        else
+        {
+            jobs.push_back(BatchJob{line.substr(0, tabIndex), line.substr(tabIndex + 1)});
+        }
+    }
+
+    return true;
+}
+
+namespace
+{
+    // Lists one directory and queues its subdirectories as new tasks, so big trees are read by all the workers
+    void walkDirectory(WorkStealingPool& pool, fs::path dir, std::mutex& mutex, std::vector<std::string>& files, bool& failed)
+    {
+        pool.submit([&pool, dir, &mutex, &files, &failed] {
+            std::error_code ec;
+            std::vector<std::string> found;
+
+            fs::directory_iterator it(dir, ec), end;
+            for (; !ec && it != end; it.increment(ec))
+            {
+                std::error_code entryEc;
+                if (it->is_directory(entryEc) && !it->is_symlink(entryEc))
+                {
+                    walkDirectory(pool, it->path(), mutex, files, failed);
+                }
+                else if (it->is_regular_file(entryEc) && isWaveFile(it->path()))
+                {
+                    found.push_back(it->path().string());
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ec)
+            {
+                std::cerr << "Can't read the directory \"" << dir.string() << "\"" << std::endl;
+                failed = true;
+            }
+            files.insert(files.end(), found.begin(), found.end());
+        });
+    }
+}
+
+bool collectWaveFiles(const char *dir, unsigned threadCount, std::vector<std::string> &files)
+{
+    std::error_code ec;
+    if (!fs::is_directory(dir, ec))
+    {
+        std::cerr << "Can't read the directory \"" << dir << "\"" << std::endl;
+        return false;
+    }
+
+    std::mutex mutex;
+    bool failed = false;
+    size_t firstIndex = files.size();
+    {
+        WorkStealingPool pool(threadCount);
+        walkDirectory(pool, dir, mutex, files, failed);
+        pool.wait();
+    }
+
+    std::sort(files.begin() + firstIndex, files.end());
+    return !failed;
+}
+
+bool collectBatchDirectory(const char *sourceDir, const char *targetDir, unsigned threadCount, std::vector<BatchJob> &jobs)
+{
+    std::vector<std::string> files;
+
+    if (!collectWaveFiles(sourceDir, threadCount, files))
+    {
+        return false;
+    }
+
+    for (std::string& file: files)
+    {
+        BatchJob job;
+        if (targetDir)
+        {
+            job.targetPath = (fs::path(targetDir) / fs::relative(file, sourceDir)).string();
+        }
+        job.sourcePath = std::move(file);
+        jobs.push_back(std::move(job));
+    }
+
+    return true;
+}
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // The status line of every file and the totals for the summary, shared by the workers
+    class BatchReport
+    {
+    public:
+        void add(const BatchJob& job, bool patched, uint64_t size, Clock::time_point jobStartTime)
+        {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - jobStartTime).count();
+
+            if (patched) {
+                m_patchedBytes += size;
+            } else {
+                m_failedCount++;
+            }
+
+            std::lock_guard<std::mutex> lock(m_outputMutex);
+            std::cout << (patched ? "OK     " : "FAILED ") << job.sourcePath;
+            if (!job.targetPath.empty())
+            {
+                std::cout << " -> " << job.targetPath;
+            }
+            std::cout << " (" << size / (1024.0 * 1024.0) << " MB, " << ms << " ms)" << std::endl;
+        }
+
+        bool printSummary(size_t jobCount, Clock::time_point startTime, const std::string& runner) const
+        {
+            double seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+            if (seconds <= 0)
+            {
+                seconds = 1e-9;
+            }
+
+            std::cout << "Patched " << jobCount - m_failedCount << " of " << jobCount << " files in " << seconds << " s on "
+                      << runner << ": " << (jobCount - m_failedCount) / seconds << " files/s, "
+                      << m_patchedBytes / (1024.0 * 1024.0) / seconds << " MB/s" << std::endl;
+
+            return m_failedCount == 0;
+        }
+
+    private:
+        std::mutex m_outputMutex;
+        std::atomic<size_t> m_failedCount{0};
+        std::atomic<uint64_t> m_patchedBytes{0};
+    };
+
+    bool createTargetDirectory(const BatchJob& job)
+    {
+        std::error_code ec;
+        fs::path targetParent = fs::path(job.targetPath).parent_path();
+        if (!targetParent.empty())
+        {
+            fs::create_directories(targetParent, ec);
+        }
+        return !ec;
+    }
+
+    // Source sizes of the jobs, and the job indexes from the smallest to the biggest file
+    void sortBySize(const std::vector<BatchJob>& jobs, std::vector<uint64_t>& sizes, std::vector<size_t>& order)
+    {
+        sizes.resize(jobs.size());
+        order.resize(jobs.size());
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            sizes[i] = fileSize(jobs[i].sourcePath);
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&sizes](size_t a, size_t b) { return sizes[a] < sizes[b]; });
+    }
+
+    // Returns the number of threads that did the work
+    unsigned patchOnPool(const std::vector<BatchJob>& jobs, const std::vector<uint64_t>& sizes, const std::vector<size_t>& order,
+                         unsigned threadCount, const PatchOptions& options, BatchReport& report)
+    {
+        WorkStealingPool pool(threadCount);
+
+        // Workers run their newest task first, so the biggest files are queued last and start first
+        for (size_t index: order)
+        {
+            pool.submit([&, index] {
+                const BatchJob& job = jobs[index];
+                auto jobStartTime = Clock::now();
+                bool patched;
+
+                if (job.targetPath.empty())
+                {
+                    patched = patchFileInPlace(job.sourcePath.c_str(), options);
+                }
+                else
+                {
+                    createTargetDirectory(job);
+                    patched = patchFile(job.sourcePath.c_str(), job.targetPath.c_str(), options);
+                }
+
+                report.add(job, patched, sizes[index], jobStartTime);
+            });
+        }
+
+        pool.wait();
+        return pool.threadCount();
+    }
+
+    // Reads whole files, patches them in memory on the engine's workers and writes them back with all the transfers
+    // of up to queueDepth files queued on the engine at once, so small files don't wait for each other's latency
+    class AsyncBatchRunner
+    {
+    public:
+        static constexpr size_t queueDepth = 64;
+        static constexpr uint64_t maxBytesInFlight = 256 * 1024 * 1024;
+
+        AsyncBatchRunner(IoEngine& engine, const std::vector<BatchJob>& jobs, const std::vector<uint64_t>& sizes,
+                         const PatchOptions& options, BatchReport& report)
+            : m_engine(engine), m_jobs(jobs), m_sizes(sizes), m_options(options), m_report(report) {}
+
+        void run(const std::vector<size_t>& order)
+        {
+            m_order = &order;
+            m_next = 0;
+
+            startJobs();
+            while (m_engine.poll())
+            {
+                startJobs();
+            }
+        }
+
+    private:
+        struct Transfer {
+            size_t index;
+            int sourceFd{-1};
+            int targetFd{-1};
+            std::string partPath;
+            std::shared_ptr<std::vector<uint8_t>> source;
+            std::vector<uint8_t> output;
+            bool patched{false};
+            uint64_t done{0};
+            Clock::time_point startTime;
+        };
+
+        void startJobs()
+        {
+            while (m_next < m_order->size() && m_inFlight < queueDepth
+                   && (m_inFlight == 0 || m_bytesInFlight + m_sizes[(*m_order)[m_next]] <= maxBytesInFlight))
+            {
+                start((*m_order)[m_next++]);
+            }
+        }
+
+        void start(size_t index)
+        {
+            auto transfer = std::make_shared<Transfer>();
+            transfer->index = index;
+            transfer->startTime = Clock::now();
+            m_inFlight++;
+            m_bytesInFlight += m_sizes[index];
+
+            const BatchJob& job = m_jobs[index];
+            transfer->sourceFd = open(job.sourcePath.c_str(), O_RDONLY);
+            if (transfer->sourceFd < 0)
+            {
+                std::cerr << "Can't open the specified file \"" << job.sourcePath << "\"" << std::endl;
+                finish(transfer, false);
+                return;
+            }
+
+            transfer->source = std::make_shared<std::vector<uint8_t>>(m_sizes[index]);
+            readMore(transfer);
+        }
+
+        void readMore(const std::shared_ptr<Transfer>& transfer)
+        {
+            std::vector<uint8_t>& source = *transfer->source;
+            m_engine.read(transfer->sourceFd, source.data() + transfer->done, source.size() - transfer->done, transfer->done,
+                          [this, transfer](ssize_t result) {
+                if (result < 0)
+                {
+                    std::cerr << "Can't read the file \"" << m_jobs[transfer->index].sourcePath << "\"" << std::endl;
+                    finish(transfer, false);
+                    return;
+                }
+
+                transfer->done += result;
+                if (result > 0 && transfer->done < transfer->source->size())
+                {
+                    readMore(transfer);
+                    return;
+                }
+
+                // The file may have shrunk since it was listed
+                transfer->source->resize(transfer->done);
+                patch(transfer);
+            });
+        }
+
+        // Decoding, patching and serializing run on a worker, the engine thread only moves on to the write
+        void patch(const std::shared_ptr<Transfer>& transfer)
+        {
+            close(transfer->sourceFd);
+            transfer->sourceFd = -1;
+
+            m_engine.runWork([this, transfer] {
+                const BatchJob& job = m_jobs[transfer->index];
+                const std::vector<uint8_t>& source = *transfer->source;
+                IOWave ioObj(m_options.traceInfo);
+
+                transfer->patched = ioObj.loadFromMemory(job.sourcePath.c_str(), source.data(), source.size(), transfer->source)
+                                    && applyPatchOptions(ioObj, job.sourcePath.c_str(), m_options)
+                                    && (!m_options.autoMarkers || addAutoMarkers(ioObj, source.data(), source.size(), *m_options.autoMarkers))
+                                    && ioObj.saveToMemory(transfer->output, source.data(), source.size());
+            }, [this, transfer](ssize_t) {
+                transfer->source.reset();
+                if (!transfer->patched)
+                {
+                    finish(transfer, false);
+                    return;
+                }
+                writeTarget(transfer);
+            });
+        }
+
+        void writeTarget(const std::shared_ptr<Transfer>& transfer)
+        {
+            const BatchJob& job = m_jobs[transfer->index];
+
+            // Like IOWave::save, the target only gets its name once it's complete
+            createTargetDirectory(job);
+            transfer->partPath = job.targetPath + ".part";
+            transfer->targetFd = open(transfer->partPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (transfer->targetFd < 0)
+            {
+                std::cerr << "Can't open the specified file \"" << transfer->partPath << "\"" << std::endl;
+                finish(transfer, false);
+                return;
+            }
+
+            transfer->done = 0;
+            writeMore(transfer);
+        }
+
+        void writeMore(const std::shared_ptr<Transfer>& transfer)
+        {
+            std::vector<uint8_t>& output = transfer->output;
+            m_engine.write(transfer->targetFd, output.data() + transfer->done, output.size() - transfer->done, transfer->done,
+                           [this, transfer](ssize_t result) {
+                if (result <= 0)
+                {
+                    std::cerr << "Error writing the file \"" << m_jobs[transfer->index].targetPath << "\"" << std::endl;
+                    finish(transfer, false);
+                    return;
+                }
+
+                transfer->done += result;
+                if (transfer->done < transfer->output.size())
+                {
+                    writeMore(transfer);
+                    return;
+                }
+                finish(transfer, true);
+            });
+        }
+
+        void finish(const std::shared_ptr<Transfer>& transfer, bool patched)
+        {
+            if (transfer->sourceFd >= 0) close(transfer->sourceFd);
+            if (transfer->targetFd >= 0 && close(transfer->targetFd) != 0)
+            {
+                patched = false;
+            }
+            transfer->sourceFd = transfer->targetFd = -1;
+
+            if (!transfer->partPath.empty())
+            {
+                const std::string& targetPath = m_jobs[transfer->index].targetPath;
+                if (patched && std::rename(transfer->partPath.c_str(), targetPath.c_str()) != 0)
+                {
+                    std::cerr << "Can't replace the file \"" << targetPath << "\"" << std::endl;
+                    patched = false;
+                }
+                if (!patched)
+                {
+                    std::remove(transfer->partPath.c_str());
+                }
+            }
+
+            m_inFlight--;
+            m_bytesInFlight -= m_sizes[transfer->index];
+            m_report.add(m_jobs[transfer->index], patched, m_sizes[transfer->index], transfer->startTime);
+        }
+
+        IoEngine& m_engine;
+        const std::vector<BatchJob>& m_jobs;
+        const std::vector<uint64_t>& m_sizes;
+        const PatchOptions& m_options;
+        BatchReport& m_report;
+
+        const std::vector<size_t>* m_order{nullptr};
+        size_t m_next{0};
+        size_t m_inFlight{0};
+        uint64_t m_bytesInFlight{0};
+    };
+}
+
+bool runBatch(std::vector<BatchJob> jobs, unsigned threadCount, const PatchOptions& options)
+{
+    std::vector<uint64_t> sizes;
+    std::vector<size_t> order;
+    sortBySize(jobs, sizes, order);
+
+    BatchReport report;
+    auto startTime = Clock::now();
+
+    threadCount = patchOnPool(jobs, sizes, order, threadCount, options, report);
+
+    return report.printSummary(jobs.size(), startTime, std::to_string(threadCount) + " threads");
+}
+
+bool runBatchAsync(std::vector<BatchJob> jobs, unsigned threadCount, const PatchOptions& options)
+{
+    static const uint64_t maxFileSize = 16 * 1024 * 1024;
+
+    std::vector<uint64_t> sizes;
+    std::vector<size_t> order;
+    sortBySize(jobs, sizes, order);
+
+    // Big files are better off with ChunkCopier than going through memory, and in place patches need the undo journal
+    std::vector<size_t> asyncOrder;
+    std::vector<size_t> poolOrder;
+    for (size_t index: order)
+    {
+        const BatchJob& job = jobs[index];
+        bool async = !job.targetPath.empty() && job.targetPath != job.sourcePath && sizes[index] <= maxFileSize;
+        (async ? asyncOrder : poolOrder).push_back(index);
+    }
+
+    BatchReport report;
+    auto startTime = Clock::now();
+
+    std::unique_ptr<IoEngine> engine = IoEngine::create(AsyncBatchRunner::queueDepth, threadCount);
+    AsyncBatchRunner(*engine, jobs, sizes, options, report).run(asyncOrder);
+    std::string runner = engine->name();
+    engine.reset();
+
+    if (!poolOrder.empty())
+    {
+        threadCount = patchOnPool(jobs, sizes, poolOrder, threadCount, options, report);
+        runner += " and " + std::to_string(threadCount) + " threads";
+    }
+
+    return report.printSummary(jobs.size(), startTime, runner);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct PatchOptions;
+
+struct BatchJob {
+    std::string sourcePath;
+    std::string targetPath; // empty when the source is patched in place
+};
+
+// One job per line: "<sourcePath>\t<targetPath>", or just "<path>" when patching in place
+bool readBatchManifest(const char* manifestPath, std::vector<BatchJob>& jobs);
+
+// Appends every .wav file under dir, sorted by path. Subdirectories are listed in parallel on threadCount workers
+bool collectWaveFiles(const char* dir, unsigned threadCount, std::vector<std::string>& files);
+
+// Every .wav file under sourceDir, written to the same relative path under targetDir,
+// or patched in place when targetDir is null
+bool collectBatchDirectory(const char* sourceDir, const char* targetDir, unsigned threadCount, std::vector<BatchJob>& jobs);
+
+// Patches all the files on threadCount workers, prints the status of every file and a summary.
+// Returns false if any of the files failed
+bool runBatch(std::vector<BatchJob> jobs, unsigned threadCount, const PatchOptions& options);
+
+// Same, but the files up to 16MB are read, patched in memory and written with many transfers in flight on an IoEngine,
+// which pays off for big libraries of small files. The bigger files and the in place patches go to threadCount workers
+bool runBatchAsync(std::vector<BatchJob> jobs, unsigned threadCount, const PatchOptions& options);
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstring>
+#include <cstddef>
+#include <memory>
+
+#include "littleendianint.h"
+
+// Decodes little endian fields from a chunk payload that was read into memory with a single read, or is mapped.
+// Reading past the end yields zeros and marks the reader as failed instead of touching foreign memory.
+// When the bytes outlive the reader, owner keeps them alive, and chunks may refer to them instead of copying
+class ByteReader
+{
+public:
+    ByteReader(const uint8_t* data, size_t size, std::shared_ptr<const void> owner = nullptr)
+        : m_data(data), m_size(size), m_owner(std::move(owner)) {}
+
+    const uint8_t* data() const { return m_data + m_pos; }
+    size_t position() const { return m_pos; }
+    size_t remaining() const { return m_size - m_pos; }
+    const std::shared_ptr<const void>& owner() const { return m_owner; }
+    bool atEnd() const { return m_pos == m_size; }
+    bool failed() const { return m_failed; }
+
+    // Returns the next count bytes and moves past them, nullptr if there are less
+    const uint8_t* take(size_t count)
+    {
+        if (count > remaining())
+        {
+            m_pos = m_size;
+            m_failed = true;
+            return nullptr;
+        }
+
+        const uint8_t* p = m_data + m_pos;
+        m_pos += count;
+        return p;
+    }
+
+    void skip(size_t count)
+    {
+        take(count);
+    }
+
+    void readBytes(void* target, size_t count)
+    {
+        const uint8_t* p = take(count);
+        if (p) {
+            memcpy(target, p, count);
+        } else {
+            memset(target, 0, count);
+        }
+    }
+
+    template <typename T>
+    T read()
+    {
+        LittleEndianInt<T> value;
+        readBytes(value.data, sizeof(T));
+        return value.getInt();
+    }
+
+    // A reader over the next count bytes, clamped to what's left
+    ByteReader subReader(size_t count)
+    {
+        count = count < remaining() ? count : remaining();
+        return ByteReader(take(count), count, m_owner);
+    }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_pos{0};
+    bool m_failed{false};
+    std::shared_ptr<const void> m_owner;
+};
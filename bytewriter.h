@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "littleendianint.h"
+
+// Encodes little endian fields at the end of a byte buffer. The caller reserves the buffer
+// from the known chunk sizes, so serializing never reallocates
+class ByteWriter
+{
+public:
+    explicit ByteWriter(std::vector<uint8_t>& buffer): m_buffer(buffer) {}
+
+    size_t size() const { return m_buffer.size(); }
+
+    void writeBytes(const void* data, size_t count)
+    {
+        const uint8_t* p = (const uint8_t*)data;
+        m_buffer.insert(m_buffer.end(), p, p + count);
+    }
+
+    // Grows the buffer by count bytes for the caller to fill, for whole tables encoded at once
+    uint8_t* append(size_t count)
+    {
+        size_t offset = m_buffer.size();
+        m_buffer.resize(offset + count);
+        return m_buffer.data() + offset;
+    }
+
+    void writeZeros(size_t count)
+    {
+        m_buffer.resize(m_buffer.size() + count, 0);
+    }
+
+    template <typename T>
+    void write(T value)
+    {
+        LittleEndianInt<T> littleEndianValue(value);
+        writeBytes(littleEndianValue.data, sizeof(T));
+    }
+
+private:
+    std::vector<uint8_t>& m_buffer;
+};
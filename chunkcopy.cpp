@@ -0,0 +1,432 @@
+#include "chunkcopy.h"
+#include "wavdata.h"
+#include "fileio.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdlib>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+std::ostream &operator<<(std::ostream &os, const CopyStats &stats)
+{
+    os << "reflink " << stats.reflinked << " bytes, copy_file_range/splice " << stats.kernelCopied
+       << " bytes, buffered " << stats.bufferCopied << " bytes";
+    return os;
+}
+
+CopyStats streamCopy(int sourceFd, int targetFd, uint64_t size)
+{
+    constexpr size_t bufferSize = 1024 * 1024;
+
+    CopyStats stats;
+    bool toEnd = size == UINT64_MAX;
+
+#ifdef __linux__
+    while (size > 0)
+    {
+        ssize_t moved = splice(sourceFd, nullptr, targetFd, nullptr, std::min<uint64_t>(size, bufferSize), SPLICE_F_MOVE | SPLICE_F_MORE);
+
+        if (moved < 0)
+        {
+            if (errno == EINTR) {
+                continue;
+            }
+            // Neither side is a pipe, or one that can't be spliced: the buffer takes over
+            if (errno == EINVAL || errno == ESPIPE || errno == EBADF) {
+                break;
+            }
+            std::cerr << "Stream copy: splice failed, errno " << errno << std::endl;
+            return stats;
+        }
+        if (moved == 0)
+        {
+            stats.succeeded = toEnd;
+            return stats;
+        }
+
+        size -= moved;
+        stats.kernelCopied += moved;
+    }
+#endif
+
+    std::vector<char> buffer(std::min<uint64_t>(size, bufferSize));
+
+    while (size > 0)
+    {
+        size_t count = readStream(sourceFd, buffer.data(), std::min<uint64_t>(size, buffer.size()));
+        if (count > 0 && !writeStream(targetFd, buffer.data(), count))
+        {
+            std::cerr << "Stream copy: error writing output" << std::endl;
+            return stats;
+        }
+        if (count == 0)
+        {
+            stats.succeeded = toEnd;
+            return stats;
+        }
+
+        size -= count;
+        stats.bufferCopied += count;
+    }
+
+    stats.succeeded = true;
+    return stats;
+}
+
+ChunkCopier::ChunkCopier(const char *sourcePath, const char *targetPath)
+{
+    m_sourceFd = open(sourcePath, O_RDONLY);
+    m_targetFd = open(targetPath, O_WRONLY);
+
+    struct stat st;
+    bool targetKnown = m_targetFd >= 0 && fstat(m_targetFd, &st) == 0;
+    if (targetKnown && st.st_blksize > 0)
+    {
+        m_blockSize = st.st_blksize;
+    }
+
+    struct stat sourceSt;
+    if (targetKnown && m_sourceFd >= 0 && fstat(m_sourceFd, &sourceSt) == 0 && sourceSt.st_dev != st.st_dev)
+    {
+        m_reflinkSupported = false;
+        m_kernelCopySupported = false;
+    }
+}
+
+ChunkCopier::~ChunkCopier()
+{
+    if (m_sourceFd >= 0) close(m_sourceFd);
+    if (m_targetFd >= 0) close(m_targetFd);
+}
+
+CopyStats ChunkCopier::copy(const ChunkLocation &source, uint64_t targetOffset)
+{
+    CopyStats stats;
+    uint64_t sourceOffset = source.startOffset;
+    uint64_t size = source.size;
+
+    // Extents can only be shared when both ranges have the same position inside a filesystem block
+    if (m_reflinkSupported && sourceOffset % m_blockSize == targetOffset % m_blockSize)
+    {
+        uint64_t head = (m_blockSize - sourceOffset % m_blockSize) % m_blockSize;
+
+        if (head < size && (size - head) >= m_blockSize)
+        {
+            uint64_t alignedSize = (size - head) / m_blockSize * m_blockSize;
+
+            if (reflink(sourceOffset + head, targetOffset + head, alignedSize))
+            {
+                CopyStats tail = copy(ChunkLocation{sourceOffset + head + alignedSize, size - head - alignedSize},
+                                      targetOffset + head + alignedSize);
+                size = head;
+
+                stats.reflinked = alignedSize + tail.reflinked;
+                stats.kernelCopied = tail.kernelCopied;
+                stats.bufferCopied = tail.bufferCopied;
+                if (!tail.succeeded) {
+                    return stats;
+                }
+            }
+        }
+    }
+
+    if (!kernelCopy(sourceOffset, targetOffset, size, stats))
+    {
+        return stats;
+    }
+
+    if (size > 0)
+    {
+        if (!bufferCopy(sourceOffset, targetOffset, size))
+        {
+            return stats;
+        }
+        stats.bufferCopied += size;
+    }
+
+    stats.succeeded = true;
+    return stats;
+}
+
+bool ChunkCopier::reflink(uint64_t sourceOffset, uint64_t targetOffset, uint64_t size)
+{
+#ifdef FICLONERANGE
+    file_clone_range range;
+    range.src_fd = m_sourceFd;
+    range.src_offset = sourceOffset;
+    range.src_length = size;
+    range.dest_offset = targetOffset;
+
+    if (ioctl(m_targetFd, FICLONERANGE, &range) == 0)
+    {
+        return true;
+    }
+#else
+    (void)sourceOffset; (void)targetOffset; (void)size;
+#endif
+    // Not a reflink capable filesystem, or source and target are on different ones: don't try again
+    m_reflinkSupported = false;
+    return false;
+}
+
+// Copies as much as the kernel agrees to and advances the offsets, whatever is left goes through bufferCopy
+bool ChunkCopier::kernelCopy(uint64_t &sourceOffset, uint64_t &targetOffset, uint64_t &size, CopyStats &stats)
+{
+#ifdef __linux__
+    while (m_kernelCopySupported && size > 0)
+    {
+        loff_t inOffset = sourceOffset;
+        loff_t outOffset = targetOffset;
+        ssize_t copied = copy_file_range(m_sourceFd, &inOffset, m_targetFd, &outOffset, size, 0);
+
+        if (copied < 0)
+        {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP || errno == EBADF)
+            {
+                m_kernelCopySupported = false;
+                break;
+            }
+            std::cerr << "Copy chunk: copy_file_range failed, errno " << errno << std::endl;
+            return false;
+        }
+        if (copied == 0)
+        {
+            std::cerr << "Copy chunk: unexpected end of input file" << std::endl;
+            return false;
+        }
+
+        sourceOffset += copied;
+        targetOffset += copied;
+        size -= copied;
+        stats.kernelCopied += copied;
+    }
+#else
+    (void)sourceOffset; (void)targetOffset; (void)size; (void)stats;
+#endif
+    return true;
+}
+
+namespace
+{
+
+// Buffers handed from the reading thread to the writing one in order. Reading blocks while all of them
+// wait to be written, writing blocks until the next one is read
+class BufferRing
+{
+public:
+    static constexpr size_t bufferCount = 4;
+    static constexpr size_t bufferSize = 8 * 1024 * 1024;
+    static constexpr size_t alignment = 4096;
+
+    struct Slot {
+        std::unique_ptr<char, decltype(&free)> data{nullptr, &free};
+        size_t size{0};
+    };
+
+    bool allocate(uint64_t totalSize)
+    {
+        size_t size = std::min<uint64_t>(bufferSize, (totalSize + alignment - 1) / alignment * alignment);
+        for (Slot& slot: m_slots)
+        {
+            void* data = nullptr;
+            if (posix_memalign(&data, alignment, size) != 0)
+            {
+                return false;
+            }
+            slot.data.reset((char*)data);
+        }
+        m_capacity = size;
+        return true;
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+    // Reading side: the next free slot, nullptr once the writer gave up
+    Slot* acquireFree()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [this] { return m_filled < bufferCount || m_aborted; });
+        return m_aborted ? nullptr : &m_slots[(m_first + m_filled) % bufferCount];
+    }
+
+    void publish()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_filled++;
+        m_changed.notify_all();
+    }
+
+    // Writing side: the oldest filled slot, nullptr once the reader gave up
+    Slot* acquireFilled()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [this] { return m_filled > 0 || m_aborted; });
+        return m_filled > 0 ? &m_slots[m_first] : nullptr;
+    }
+
+    void release()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_first = (m_first + 1) % bufferCount;
+        m_filled--;
+        m_changed.notify_all();
+    }
+
+    void abort()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_aborted = true;
+        m_changed.notify_all();
+    }
+
+private:
+    Slot m_slots[bufferCount];
+    size_t m_capacity{0};
+    size_t m_first{0};
+    size_t m_filled{0};
+    bool m_aborted{false};
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+};
+
+}
+
+CopyStats ChunkCopier::copyThrough(const ChunkLocation &source, uint64_t targetOffset, const Inspector &inspector)
+{
+    CopyStats stats;
+    stats.succeeded = bufferCopy(source.startOffset, targetOffset, source.size, &inspector);
+    if (stats.succeeded) {
+        stats.bufferCopied = source.size;
+    }
+    return stats;
+}
+
+bool ChunkCopier::bufferCopy(uint64_t sourceOffset, uint64_t targetOffset, uint64_t size, const Inspector* inspector)
+{
+    // A single buffer can't overlap anything, a thread isn't worth it
+    if (size > BufferRing::bufferSize)
+    {
+        return pipelinedCopy(sourceOffset, targetOffset, size, inspector);
+    }
+
+    std::vector<char> buffer(size);
+
+    if (!readAll(m_sourceFd, buffer.data(), size, sourceOffset))
+    {
+        std::cerr << "Copy chunk: error reading input file" << std::endl;
+        return false;
+    }
+
+    if (inspector)
+    {
+        (*inspector)((const uint8_t*)buffer.data(), size);
+    }
+
+    if (!writeAll(m_targetFd, buffer.data(), size, targetOffset))
+    {
+        std::cerr << "Copy chunk: error writing output file" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ChunkCopier::pipelinedCopy(uint64_t sourceOffset, uint64_t targetOffset, uint64_t size, const Inspector* inspector)
+{
+    BufferRing ring;
+    if (!ring.allocate(size))
+    {
+        std::cerr << "Copy chunk: can't allocate the copy buffers" << std::endl;
+        return false;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(m_sourceFd, sourceOffset, size, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    bool readFailed = false;
+
+    std::thread reader([&]() {
+        uint64_t offset = sourceOffset;
+        uint64_t left = size;
+
+        while (left > 0)
+        {
+            BufferRing::Slot* slot = ring.acquireFree();
+            if (!slot)
+            {
+                return;
+            }
+
+            slot->size = std::min<uint64_t>(ring.capacity(), left);
+            if (!readAll(m_sourceFd, slot->data.get(), slot->size, offset))
+            {
+                readFailed = true;
+                ring.abort();
+                return;
+            }
+            ring.publish();
+
+            offset += slot->size;
+            left -= slot->size;
+        }
+    });
+
+    bool written = true;
+    uint64_t left = size;
+
+    while (left > 0)
+    {
+        BufferRing::Slot* slot = ring.acquireFilled();
+        if (!slot)
+        {
+            break;
+        }
+
+        // On the writing thread, while the reader fills the next buffers
+        if (inspector)
+        {
+            (*inspector)((const uint8_t*)slot->data.get(), slot->size);
+        }
+
+        if (!writeAll(m_targetFd, slot->data.get(), slot->size, targetOffset))
+        {
+            written = false;
+            ring.abort();
+            break;
+        }
+
+        targetOffset += slot->size;
+        left -= slot->size;
+        ring.release();
+    }
+
+    reader.join();
+
+    if (readFailed)
+    {
+        std::cerr << "Copy chunk: error reading input file" << std::endl;
+        return false;
+    }
+    if (!written)
+    {
+        std::cerr << "Copy chunk: error writing output file" << std::endl;
+        return false;
+    }
+    return true;
+}
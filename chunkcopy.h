@@ -0,0 +1,61 @@
+#pragma once
+
+#include <inttypes.h>
+#include <ostream>
+#include <functional>
+
+struct ChunkLocation;
+
+// How many bytes of a chunk went through each copy path
+struct CopyStats {
+    bool succeeded{false};
+    uint64_t reflinked{0};      // shared with the source by FICLONERANGE, no data written at all
+    uint64_t kernelCopied{0};   // copied by copy_file_range or splice, the data never leaves the kernel
+    uint64_t bufferCopied{0};   // read into a user space buffer and written back
+};
+
+std::ostream& operator<<(std::ostream& os, const CopyStats& stats);
+
+// Passes size bytes on from one descriptor to the other in order, UINT64_MAX passes everything up to the end of
+// the source. Goes through splice when one side is a pipe, otherwise through a fixed buffer
+CopyStats streamCopy(int sourceFd, int targetFd, uint64_t size);
+
+
+// Copies unchanged chunk payloads from the source file to the target file.
+// Block-aligned runs are reflinked where the filesystem supports it (btrfs, XFS), the rest goes through
+// copy_file_range, and anything the kernel refuses falls back to a buffered copy.
+// The buffered copy reads on a thread of its own into a ring of large buffers while the calling thread writes,
+// so the source and the target device are busy at the same time. It is also used right away when the files are
+// on different devices, where copy_file_range would alternate between reading and writing every piece
+class ChunkCopier
+{
+public:
+    ChunkCopier(const char* sourcePath, const char* targetPath);
+    ~ChunkCopier();
+
+    ChunkCopier(const ChunkCopier&) = delete;
+    ChunkCopier& operator=(const ChunkCopier&) = delete;
+
+    bool isOpen() const { return m_sourceFd >= 0 && m_targetFd >= 0; }
+
+    CopyStats copy(const ChunkLocation& source, uint64_t targetOffset);
+
+    // Sees the data in order, in pieces of any size, before they are written
+    using Inspector = std::function<void(const uint8_t* data, size_t size)>;
+
+    // Copies through the user space buffers only, so that inspector looks at every byte on the way without
+    // reading the source a second time
+    CopyStats copyThrough(const ChunkLocation& source, uint64_t targetOffset, const Inspector& inspector);
+
+private:
+    bool reflink(uint64_t sourceOffset, uint64_t targetOffset, uint64_t size);
+    bool kernelCopy(uint64_t& sourceOffset, uint64_t& targetOffset, uint64_t& size, CopyStats& stats);
+    bool bufferCopy(uint64_t sourceOffset, uint64_t targetOffset, uint64_t size, const Inspector* inspector = nullptr);
+    bool pipelinedCopy(uint64_t sourceOffset, uint64_t targetOffset, uint64_t size, const Inspector* inspector);
+
+    int m_sourceFd{-1};
+    int m_targetFd{-1};
+    uint64_t m_blockSize{4096};
+    bool m_reflinkSupported{true};
+    bool m_kernelCopySupported{true};
+};
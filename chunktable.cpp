@@ -0,0 +1,137 @@
+#include "chunktable.h"
+#include "factory.h"
+
+#include <algorithm>
+
+int ChunkTable::commonSlot(FourCC id)
+{
+    switch (id)
+    {
+    case "fmt "_cc:
+        return 0;
+    case "data"_cc:
+        return 1;
+    case "cue "_cc:
+        return 2;
+    case "LIST"_cc:
+        return 3;
+    case "ds64"_cc:
+        return 4;
+    default:
+        return -1;
+    }
+}
+
+size_t ChunkTable::find(FourCC id) const
+{
+    int slot = commonSlot(id);
+    if (slot >= 0)
+    {
+        return m_commonIndex[slot];
+    }
+
+    for (size_t i = 0; i < m_entries.size(); i++)
+    {
+        if (m_entries[i].id == id)
+        {
+            return i;
+        }
+    }
+    return npos;
+}
+
+const ChunkData *ChunkTable::view(size_t index) const
+{
+    const EntryState& state = m_states[index];
+    if (!state.raw)
+    {
+        return m_entries[index].data.get();
+    }
+
+    if (!state.view)
+    {
+        state.view = Factory::decodeChunkData(static_cast<const GeneralChunkData&>(*m_entries[index].data), m_resource);
+    }
+    return state.view.get();
+}
+
+ChunkData *ChunkTable::edit(size_t index)
+{
+    EntryState& state = m_states[index];
+    if (state.raw)
+    {
+        view(index);
+        m_entries[index].data = std::move(state.view);
+        state.raw = false;
+    }
+    return m_entries[index].data.get();
+}
+
+size_t ChunkTable::append(ChunkObject obj, bool raw)
+{
+    size_t index = m_entries.size();
+    int slot = commonSlot(obj.id);
+
+    m_states.push_back(EntryState{obj.getDataSize(), raw, nullptr});
+    m_totalSize += m_states.back().size;
+    m_entries.push_back(std::move(obj));
+
+    if (slot >= 0 && m_commonIndex[slot] == npos)
+    {
+        m_commonIndex[slot] = index;
+    }
+    return index;
+}
+
+void ChunkTable::insert(size_t index, ChunkObject obj)
+{
+    m_states.insert(m_states.begin() + index, EntryState{obj.getDataSize(), false, nullptr});
+    m_totalSize += m_states[index].size;
+    m_entries.insert(m_entries.begin() + index, std::move(obj));
+    rebuildIndex();
+}
+
+void ChunkTable::erase(size_t index)
+{
+    m_totalSize -= m_states[index].size;
+    m_states.erase(m_states.begin() + index);
+    m_entries.erase(m_entries.begin() + index);
+    rebuildIndex();
+}
+
+void ChunkTable::moveToEnd(size_t index)
+{
+    std::rotate(m_states.begin() + index, m_states.begin() + index + 1, m_states.end());
+    std::rotate(m_entries.begin() + index, m_entries.begin() + index + 1, m_entries.end());
+    rebuildIndex();
+}
+
+void ChunkTable::updateSize(size_t index)
+{
+    m_totalSize -= m_states[index].size;
+    m_states[index].size = m_entries[index].getDataSize();
+    m_totalSize += m_states[index].size;
+}
+
+void ChunkTable::clear()
+{
+    m_entries.clear();
+    m_states.clear();
+    m_totalSize = 0;
+    m_commonIndex.fill(npos);
+}
+
+void ChunkTable::rebuildIndex()
+{
+    m_commonIndex.fill(npos);
+
+    // Backwards, so the first chunk of a type ends up in the index
+    for (size_t i = m_entries.size(); i-- > 0;)
+    {
+        int slot = commonSlot(m_entries[i].id);
+        if (slot >= 0)
+        {
+            m_commonIndex[slot] = i;
+        }
+    }
+}
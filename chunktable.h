@@ -0,0 +1,73 @@
+#pragma once
+
+#include "wavdata.h"
+
+#include <array>
+#include <vector>
+
+// The top level chunks of a file in output order, stored contiguously. The ID of every chunk is kept in its entry,
+// and the first fmt, data, cue, LIST and ds64 chunks are found through an index instead of a scan.
+// The bytes the chunks take in the file are summed up as they're added, erased and resized.
+//
+// Chunks loaded from a file stay raw bytes until view() or edit() asks for them, and are written back exactly as
+// they were read unless they're edited. Decoded chunks are allocated in the resource given to the table
+class ChunkTable
+{
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    using const_iterator = std::vector<ChunkObject>::const_iterator;
+
+    explicit ChunkTable(std::pmr::memory_resource* resource): m_resource(resource) {}
+
+    // The entries as they are written, raw chunks included
+    const_iterator begin() const { return m_entries.begin(); }
+    const_iterator end() const { return m_entries.end(); }
+    size_t size() const { return m_entries.size(); }
+    bool empty() const { return m_entries.empty(); }
+    const ChunkObject& operator[](size_t index) const { return m_entries[index]; }
+
+    // Index of the first chunk with the ID, npos if there's none
+    size_t find(FourCC id) const;
+
+    // The decoded chunk at index, for reading. A raw chunk is decoded on the first call and still written as raw bytes
+    const ChunkData* view(size_t index) const;
+
+    // The decoded chunk at index, for changing it. From now on the decoded chunk is written instead of the raw bytes,
+    // call updateSize when done
+    ChunkData* edit(size_t index);
+
+    // Returns the index of the new last chunk. A raw chunk is a GeneralChunkData holding the payload as it was loaded
+    size_t append(ChunkObject obj, bool raw = false);
+    void insert(size_t index, ChunkObject obj);
+    void erase(size_t index);
+
+    // Moves the chunk at index behind all the others, raw or not
+    void moveToEnd(size_t index);
+
+    // To be called after the payload of the chunk at index has changed its size
+    void updateSize(size_t index);
+
+    // Headers, payloads and padding of all the chunks
+    uint64_t totalSize() const { return m_totalSize; }
+
+    // Keeps the storage for the next file
+    void clear();
+
+private:
+    struct EntryState {
+        uint64_t size{0};       // bytes the chunk takes in the file
+        bool raw{false};
+        mutable ChunkPtr view;  // decoded raw chunk, while the entry still holds the raw bytes
+    };
+
+    // Slot of the common chunk types in m_commonIndex, -1 for the rest
+    static int commonSlot(FourCC id);
+    void rebuildIndex();
+
+    std::pmr::memory_resource* m_resource;
+    std::vector<ChunkObject> m_entries;
+    std::vector<EntryState> m_states;
+    uint64_t m_totalSize{0};
+    std::array<size_t, 5> m_commonIndex{npos, npos, npos, npos, npos};
+};
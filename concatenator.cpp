@@ -0,0 +1,205 @@
+#include "concatenator.h"
+#include "patcher.h"
+#include "chunkcopy.h"
+#include "fileio.h"
+#include "bytewriter.h"
+#include "workstealingpool.h"
+
+#include <iostream>
+#include <optional>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+
+struct Source {
+    std::optional<FormatChunkData> format;
+    ChunkLocation data;
+};
+
+bool loadSource(const char* path, const PatchOptions& options, Source& source)
+{
+    IOWave ioObj(options.traceInfo, options.inputBackend);
+
+    if (!ioObj.load(path, true))
+    {
+        return false;
+    }
+
+    const FormatChunkData* format = ioObj.getFormat();
+    const ChunkData* data = ioObj.findChunk("data"_cc);
+
+    if (!format || format->getBlockAlign() == 0 || !data || !data->getSourceLocation())
+    {
+        std::cerr << "\"" << path << "\" has no audio data in a known format" << std::endl;
+        return false;
+    }
+
+    source.format.emplace(*format);
+    source.data = *data->getSourceLocation();
+
+    // A partial frame at the end would shift every source after it
+    source.data.size -= source.data.size % format->getBlockAlign();
+    return true;
+}
+
+}
+
+bool concatenateFiles(const std::vector<const char*>& sourcePaths, const char* targetPath, unsigned threadCount,
+                      const PatchOptions& options)
+{
+    // The target is truncated before the sources are copied into it
+    for (const char* sourcePath: sourcePaths)
+    {
+        std::error_code ec;
+        if (std::filesystem::equivalent(sourcePath, targetPath, ec))
+        {
+            std::cerr << "\"" << targetPath << "\" is one of the files to join" << std::endl;
+            return false;
+        }
+    }
+
+    std::vector<Source> sources(sourcePaths.size());
+    std::vector<char> loaded(sourcePaths.size(), 0);
+    {
+        WorkStealingPool pool(threadCount);
+        for (size_t i = 0; i < sourcePaths.size(); i++)
+        {
+            pool.submit([&, i] {
+                loaded[i] = loadSource(sourcePaths[i], options, sources[i]);
+            });
+        }
+        pool.wait();
+    }
+
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        if (!loaded[i])
+        {
+            return false;
+        }
+        if (!sources[i].format->isSameFormat(*sources[0].format))
+        {
+            std::cerr << "\"" << sourcePaths[i] << "\" doesn't have the format of \"" << sourcePaths[0] << "\"" << std::endl;
+            return false;
+        }
+    }
+
+    // One cue point per source where its audio data starts, labeled like patchFile labels a file.
+    // A source without audio data shares the offset of the next one but still gets its own point
+    ChunkObject cue(makeChunk<CueChunkData>(std::pmr::get_default_resource()));
+    ChunkObject list(makeChunk<ListChunkData>(std::pmr::get_default_resource()));
+    CueChunkData* cueData = static_cast<CueChunkData*>(cue.data.get());
+    cueData->reserve(sources.size());
+
+    std::vector<std::string> names;
+    names.reserve(sources.size());
+    std::vector<std::pair<uint32_t, const std::string*>> labels;
+    labels.reserve(sources.size());
+
+    uint64_t blockAlign = sources[0].format->getBlockAlign();
+    uint64_t dataSize = 0;
+
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        uint64_t frameOffset = dataSize / blockAlign;
+        if (frameOffset > UINT32_MAX)
+        {
+            std::cerr << "\"" << sourcePaths[i] << "\" starts past the last frame a cue point can refer to" << std::endl;
+            return false;
+        }
+
+        names.push_back(fileNameFromPath(sourcePaths[i]));
+        labels.emplace_back(cueData->addPoint(frameOffset), &names.back());
+        dataSize += sources[i].data.size;
+    }
+    static_cast<ListChunkData*>(list.data.get())->setLabels(labels);
+
+    // Everything but the audio data is serialized before the first byte is written
+    ChunkObject format(makeChunk<FormatChunkData>(std::pmr::get_default_resource(), *sources[0].format));
+    ChunkObject ds64(makeChunk<DataSize64ChunkData>(std::pmr::get_default_resource()));
+
+    uint64_t dataStoredSize = ChunkObject::storedSize(dataSize);
+    uint64_t riffSize = sizeof(WaveHeader::riffType) + format.getDataSize() + dataStoredSize
+                      + cue.getDataSize() + list.getDataSize();
+    bool rf64 = riffSize >= oversizedChunkSize;
+
+    WaveHeader header;
+    header.dataSize = riffSize;
+    if (rf64)
+    {
+        riffSize += ds64.getDataSize();
+        memcpy(header.chunkID, "RF64", sizeof(header.chunkID));
+        header.dataSize = oversizedChunkSize;
+
+        DataSize64ChunkData* sizes = static_cast<DataSize64ChunkData*>(ds64.data.get());
+        sizes->setRiffSize(riffSize);
+        sizes->setDataChunkSize(dataSize);
+        sizes->setSampleCount(dataSize / blockAlign);
+    }
+
+    std::vector<uint8_t> head;
+    head.reserve(sizeof(header) + ds64.getDataSize() + format.getDataSize() + sizeof(ChunkHeader));
+    ByteWriter headWriter(head);
+    headWriter.writeBytes(&header.chunkID[0], sizeof(header));
+    if (rf64)
+    {
+        headWriter << ds64;
+    }
+    headWriter << format;
+    headWriter << ChunkHeader("data"_cc, rf64 ? oversizedChunkSize : dataSize);
+
+    std::vector<uint8_t> tail;
+    tail.reserve(1 + cue.getDataSize() + list.getDataSize());
+    ByteWriter tailWriter(tail);
+    if (dataSize % 2 != 0)
+    {
+        tailWriter.writeZeros(1);
+    }
+    tailWriter << cue;
+    tailWriter << list;
+
+    int fd = open(targetPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "Can't open the specified file \"" << targetPath << "\"" << std::endl;
+        return false;
+    }
+
+    bool written = ftruncate(fd, head.size() + dataSize + tail.size()) == 0
+                && writeAll(fd, head.data(), head.size(), 0)
+                && writeAll(fd, tail.data(), tail.size(), head.size() + dataSize);
+    close(fd);
+
+    if (!written)
+    {
+        std::cerr << "Error writing the file \"" << targetPath << "\"" << std::endl;
+        return false;
+    }
+
+    uint64_t targetOffset = head.size();
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        ChunkCopier copier(sourcePaths[i], targetPath);
+        CopyStats stats = copier.isOpen() ? copier.copy(sources[i].data, targetOffset) : CopyStats();
+
+        if (options.traceInfo)
+        {
+            std::cout << "Copied the audio data of \"" << sourcePaths[i] << "\": " << stats << std::endl;
+        }
+
+        if (!stats.succeeded)
+        {
+            std::cerr << "Can't copy the audio data of \"" << sourcePaths[i] << "\"" << std::endl;
+            return false;
+        }
+        targetOffset += sources[i].data.size;
+    }
+
+    std::cout << "Joined " << sources.size() << " files into \"" << targetPath << "\", "
+              << dataSize / blockAlign << " frames" << std::endl;
+    return true;
+}
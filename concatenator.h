@@ -0,0 +1,12 @@
+#pragma once
+
+#include <vector>
+
+struct PatchOptions;
+
+// Writes the audio data of all the sources, which must share their format, one after another into a single file.
+// Each source starts at a cue point labeled with its file name. The sources are read on threadCount workers for their
+// metadata only, then the target is written in one pass: the sizes are known up front, the audio data is copied
+// by the kernel and the cue and LIST chunks follow it
+bool concatenateFiles(const std::vector<const char*>& sourcePaths, const char* targetPath, unsigned threadCount,
+                      const PatchOptions& options);
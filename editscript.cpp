@@ -0,0 +1,116 @@
+#include "editscript.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+namespace
+{
+
+// Splits the next space separated word off the front of text
+std::string takeWord(std::string& text)
+{
+    size_t begin = text.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+    {
+        text.clear();
+        return std::string();
+    }
+
+    size_t end = text.find_first_of(" \t", begin);
+    std::string word = text.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+
+    size_t rest = end == std::string::npos ? std::string::npos : text.find_first_not_of(" \t", end);
+    text = rest == std::string::npos ? std::string() : text.substr(rest);
+    return word;
+}
+
+bool parseNumber(const std::string& word, int64_t minValue, int64_t maxValue, int64_t& value)
+{
+    if (word.empty())
+    {
+        return false;
+    }
+
+    char* end = nullptr;
+    errno = 0;
+    long long number = std::strtoll(word.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0' || number < minValue || number > maxValue)
+    {
+        return false;
+    }
+
+    value = number;
+    return true;
+}
+
+}
+
+bool readEditScript(const char *scriptPath, std::vector<EditOperation> &operations)
+{
+    std::ifstream file(scriptPath, std::ios_base::in | std::ios_base::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Can't open the edit script \"" << scriptPath << "\"" << std::endl;
+        return false;
+    }
+
+    std::string line;
+    uint64_t lineNumber = 0;
+
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+
+        std::string rest = line;
+        std::string name = takeWord(rest);
+        if (name.empty() || name[0] == '#')
+        {
+            continue;
+        }
+
+        EditOperation operation;
+        bool valid = true;
+
+        if (name == "add" || name == "rename")
+        {
+            operation.type = name == "add" ? EditOperation::Type::Add : EditOperation::Type::Rename;
+            valid = parseNumber(takeWord(rest), 0, UINT32_MAX, operation.value) && !rest.empty();
+            operation.label = rest;
+        }
+        else if (name == "delete")
+        {
+            operation.type = EditOperation::Type::Delete;
+            valid = parseNumber(takeWord(rest), 0, UINT32_MAX, operation.value) && rest.empty();
+        }
+        else if (name == "shift")
+        {
+            operation.type = EditOperation::Type::Shift;
+            valid = parseNumber(takeWord(rest), -int64_t(UINT32_MAX), UINT32_MAX, operation.value) && rest.empty();
+        }
+        else if (name == "clear")
+        {
+            operation.type = EditOperation::Type::Clear;
+            valid = rest.empty();
+        }
+        else
+        {
+            std::cerr << "Unknown operation \"" << name << "\" at line " << lineNumber << " of the edit script" << std::endl;
+            return false;
+        }
+
+        if (!valid)
+        {
+            std::cerr << "Wrong arguments of \"" << name << "\" at line " << lineNumber << " of the edit script" << std::endl;
+            return false;
+        }
+        operations.push_back(std::move(operation));
+    }
+    return true;
+}
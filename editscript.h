@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <inttypes.h>
+
+struct EditOperation {
+    enum class Type {
+        Add,        // adds a cue point at value with the label, or relabels the point already there
+        Rename,     // sets the label of the cue point with ID value
+        Delete,     // removes the cue point with ID value and its label
+        Shift,      // moves every cue point by value frames, fails if one would leave the 32 bit range
+        Clear       // drops all the cue points and labels, like IOWave::clearPointsAndLabels
+    };
+
+    Type type;
+    int64_t value{0};
+    std::string label;
+};
+
+// One operation per line, applied in order:
+//     add <frameOffset> <label>
+//     rename <cuePointId> <label>
+//     delete <cuePointId>
+//     shift <frames>
+//     clear
+// Empty lines and lines starting with '#' are skipped. Returns false on the first malformed line
+bool readEditScript(const char* scriptPath, std::vector<EditOperation>& operations);
@@ -1,21 +1,94 @@
 #include "factory.h"
 #include "wavdata.h"
 
-ChunkData* Factory::createChunkData(const ChunkHeader &header)
+#include <unordered_map>
+
+namespace
+{
+    // A function local static, so registrations from static initializers of other files find it constructed
+    std::unordered_map<uint32_t, Factory::Creator>& registeredTypes()
+    {
+        static std::unordered_map<uint32_t, Factory::Creator> types;
+        return types;
+    }
+}
+
+ChunkPtr Factory::createChunkData(const ChunkHeader &header, std::pmr::memory_resource* resource)
 {
-    if (strncmp(header.id, "cue ", 4) == 0) {
-        return new CueChunkData();
+    const auto& types = registeredTypes();
+    if (!types.empty())
+    {
+        auto it = types.find(header.id);
+        if (it != types.end()) {
+            return ChunkPtr(it->second(header));
+        }
     }
-    if (strncmp(header.id, "labl", 4) == 0) {
-        return new SubListChunkData();
+
+    switch (header.id)
+    {
+    case "cue "_cc:
+        return makeChunk<CueChunkData>(resource);
+    case "labl"_cc:
+        return makeChunk<SubListChunkData>(resource);
+    case "LIST"_cc:
+        return makeChunk<ListChunkData>(resource);
+    case "fmt "_cc:
+        return makeChunk<FormatChunkData>(resource);
+    case "ds64"_cc:
+        return makeChunk<DataSize64ChunkData>(resource);
+    default:
+        return makeChunk<GeneralChunkData>(resource, header);
     }
-    if (strncmp(header.id, "LIST", 4) == 0) {
-        return new ListChunkData();
+}
+
+ChunkPtr Factory::createFileChunkData(const ChunkHeader &header, uint64_t payloadOffset, uint64_t payloadSize, bool metadataOnly,
+                                      std::pmr::memory_resource* resource)
+{
+    if (isKeptInFile(header, metadataOnly)) {
+        return makeChunk<PassthroughChunkData>(resource, header.id, payloadOffset, payloadSize);
     }
-    if (strncmp(header.id, "fmt ", 4) == 0) {
-        return new FormatChunkData();
+    if (isDecodedOnLoad(header.id)) {
+        return createChunkData(header, resource);
     }
-    /*.....*/
+    return makeChunk<GeneralChunkData>(resource, header);
+}
 
-    return new GeneralChunkData(header);
+bool Factory::isDecodedOnLoad(FourCC id)
+{
+    return id == "ds64"_cc;
+}
+
+ChunkPtr Factory::decodeChunkData(const GeneralChunkData &raw, std::pmr::memory_resource* resource)
+{
+    ChunkPtr data = createChunkData(raw.getHeader(), resource);
+    ByteReader payload = raw.getPayload();
+    data->readDataFromBuffer(payload);
+    return data;
+}
+
+bool Factory::isKeptInFile(const ChunkHeader &header, bool metadataOnly)
+{
+    // A registered type is loaded like the built in metadata, so its creator gets to decode it
+    if (registeredTypes().count(header.id) != 0)
+    {
+        return false;
+    }
+
+    switch (header.id)
+    {
+    case "data"_cc:
+        return true;
+    case "cue "_cc:
+    case "LIST"_cc:
+    case "fmt "_cc:
+    case "ds64"_cc:
+        return false;
+    default:
+        return metadataOnly;
+    }
+}
+
+void Factory::registerChunkType(FourCC id, Creator create)
+{
+    registeredTypes()[id] = create;
 }
@@ -1,12 +1,42 @@
 #pragma once
 
+#include <inttypes.h>
 
-class ChunkHeader;
-class ChunkData;
+#include "fourcc.h"
+#include "wavdata.h"
 
 class Factory
 {
 public:
-    static ChunkData* createChunkData(const ChunkHeader& header);
+    using Creator = ChunkData* (*)(const ChunkHeader& header);
+
+    // Chunks parsed in memory, unknown types are kept as raw bytes. The built in types are allocated in resource,
+    // registered ones come from their creator on the heap
+    static ChunkPtr createChunkData(const ChunkHeader& header, std::pmr::memory_resource* resource);
+
+    // Chunks found in a file: the audio data is left there and copied over on save. With metadataOnly
+    // the same goes for every chunk that doesn't describe the format or the markers and isn't of a registered
+    // type. The rest is loaded as raw bytes, decodeChunkData turns them into the typed chunk when it's needed.
+    // Only the ds64 chunk, which tells the sizes of the chunks after it, is decoded right away
+    static ChunkPtr createFileChunkData(const ChunkHeader& header, uint64_t payloadOffset, uint64_t payloadSize, bool metadataOnly,
+                                        std::pmr::memory_resource* resource);
+    static bool isDecodedOnLoad(FourCC id);
+    static bool isKeptInFile(const ChunkHeader& header, bool metadataOnly);
+
+    static ChunkPtr decodeChunkData(const GeneralChunkData& raw, std::pmr::memory_resource* resource);
+
+    // Decodes chunks of type id with create, also for the built in types. Not thread safe, meant to be called
+    // before any file is loaded, usually through a static ChunkRegistration
+    static void registerChunkType(FourCC id, Creator create);
 };
 
+// Plugs a chunk type into the factory without touching it: in the file that defines MyChunkData,
+//     static ChunkRegistration<MyChunkData> registration("bext"_cc);
+template <typename T>
+struct ChunkRegistration
+{
+    explicit ChunkRegistration(FourCC id)
+    {
+        Factory::registerChunkType(id, [](const ChunkHeader&) -> ChunkData* { return new T(); });
+    }
+};
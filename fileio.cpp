@@ -0,0 +1,73 @@
+#include "fileio.h"
+
+#include <cerrno>
+#include <unistd.h>
+
+bool readAll(int fd, void *buffer, size_t size, uint64_t offset)
+{
+    char* p = (char*)buffer;
+    while (size > 0)
+    {
+        ssize_t res = pread(fd, p, size, offset);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            return false;
+        }
+        p += res; offset += res; size -= res;
+    }
+    return true;
+}
+
+bool writeAll(int fd, const void *buffer, size_t size, uint64_t offset)
+{
+    const char* p = (const char*)buffer;
+    while (size > 0)
+    {
+        ssize_t res = pwrite(fd, p, size, offset);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res < 0) {
+            return false;
+        }
+        p += res; offset += res; size -= res;
+    }
+    return true;
+}
+
+size_t readStream(int fd, void *buffer, size_t size)
+{
+    char* p = (char*)buffer;
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t res = read(fd, p + done, size - done);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            break;
+        }
+        done += res;
+    }
+    return done;
+}
+
+bool writeStream(int fd, const void *buffer, size_t size)
+{
+    const char* p = (const char*)buffer;
+    while (size > 0)
+    {
+        ssize_t res = write(fd, p, size);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res < 0) {
+            return false;
+        }
+        p += res; size -= res;
+    }
+    return true;
+}
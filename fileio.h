@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <inttypes.h>
+
+// Positional reads and writes that retry until the whole range is done
+bool readAll(int fd, void* buffer, size_t size, uint64_t offset);
+bool writeAll(int fd, const void* buffer, size_t size, uint64_t offset);
+
+// Sequential reads and writes, for pipes. readStream returns less than size only at the end of the input or on an error
+size_t readStream(int fd, void* buffer, size_t size);
+bool writeStream(int fd, const void* buffer, size_t size);
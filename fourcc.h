@@ -0,0 +1,57 @@
+#pragma once
+
+#include <inttypes.h>
+#include <cstddef>
+#include <string>
+#include <ostream>
+#include <stdexcept>
+
+// A chunk ID: the four characters from the file packed into an integer, the first one in the lowest byte,
+// so IDs compare with one instruction and switch statements can dispatch on them. Written as "cue "_cc
+class FourCC
+{
+public:
+    constexpr FourCC() = default;
+    constexpr explicit FourCC(uint32_t value): m_value(value) {}
+
+    static constexpr FourCC fromBytes(const char* bytes)
+    {
+        return FourCC(uint32_t(uint8_t(bytes[0])) | uint32_t(uint8_t(bytes[1])) << 8
+                      | uint32_t(uint8_t(bytes[2])) << 16 | uint32_t(uint8_t(bytes[3])) << 24);
+    }
+
+    void toBytes(char* bytes) const
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            bytes[i] = char(m_value >> (8 * i));
+        }
+    }
+
+    std::string toString() const
+    {
+        char bytes[4];
+        toBytes(bytes);
+        return std::string(bytes, 4);
+    }
+
+    constexpr uint32_t value() const { return m_value; }
+    constexpr operator uint32_t() const { return m_value; }
+
+    constexpr bool operator==(FourCC other) const { return m_value == other.m_value; }
+    constexpr bool operator!=(FourCC other) const { return m_value != other.m_value; }
+
+private:
+    uint32_t m_value{0};
+};
+
+// A literal with other than four characters doesn't compile when used as a constant
+constexpr FourCC operator""_cc(const char* id, size_t length)
+{
+    return length == 4 ? FourCC::fromBytes(id) : throw std::invalid_argument("A chunk ID has four characters");
+}
+
+inline std::ostream& operator<<(std::ostream& os, FourCC id)
+{
+    return os << id.toString();
+}
@@ -0,0 +1,287 @@
+#include "ioengine.h"
+#include "workstealingpool.h"
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cerrno>
+
+#include <unistd.h>
+
+#ifdef WAVE_PATCHER_IO_URING
+#include <liburing.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace
+{
+
+// Emulates the queue with blocking calls on a thread pool, completions are handed back to the polling thread
+class ThreadPoolEngine: public IoEngine
+{
+public:
+    explicit ThreadPoolEngine(unsigned threadCount): m_pool(threadCount) {}
+
+    virtual const char* name() const override { return "thread pool I/O"; }
+
+    virtual void read(int fd, void* buffer, size_t size, uint64_t offset, IoCompletion done) override
+    {
+        m_inFlight++;
+        m_pool.submit([this, fd, buffer, size, offset, done = std::move(done)]() mutable {
+            ssize_t result;
+            do {
+                result = pread(fd, buffer, size, offset);
+            } while (result < 0 && errno == EINTR);
+            complete(std::move(done), result < 0 ? -errno : result);
+        });
+    }
+
+    virtual void write(int fd, const void* buffer, size_t size, uint64_t offset, IoCompletion done) override
+    {
+        m_inFlight++;
+        m_pool.submit([this, fd, buffer, size, offset, done = std::move(done)]() mutable {
+            ssize_t result;
+            do {
+                result = pwrite(fd, buffer, size, offset);
+            } while (result < 0 && errno == EINTR);
+            complete(std::move(done), result < 0 ? -errno : result);
+        });
+    }
+
+    virtual void runWork(std::function<void()> work, IoCompletion done) override
+    {
+        m_inFlight++;
+        m_pool.submit([this, work = std::move(work), done = std::move(done)]() mutable {
+            work();
+            complete(std::move(done), 0);
+        });
+    }
+
+    virtual bool poll() override
+    {
+        if (m_inFlight == 0)
+        {
+            return false;
+        }
+
+        std::deque<std::pair<IoCompletion, ssize_t>> completed;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_completedAvailable.wait(lock, [this] { return !m_completed.empty(); });
+            completed.swap(m_completed);
+        }
+
+        for (auto& completion: completed)
+        {
+            m_inFlight--;
+            completion.first(completion.second);
+        }
+        return true;
+    }
+
+private:
+    void complete(IoCompletion done, ssize_t result)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_completed.emplace_back(std::move(done), result);
+        m_completedAvailable.notify_one();
+    }
+
+    size_t m_inFlight{0};   // only touched by the polling thread
+
+    std::mutex m_mutex;
+    std::condition_variable m_completedAvailable;
+    std::deque<std::pair<IoCompletion, ssize_t>> m_completed;
+
+    // Last, so the workers are joined before the queue they report to goes away
+    WorkStealingPool m_pool;
+};
+
+#ifdef WAVE_PATCHER_IO_URING
+
+// The workers of runWork report back through an eventfd that has a read queued in the ring while any work is out
+class UringEngine: public IoEngine
+{
+public:
+    explicit UringEngine(unsigned threadCount): m_pool(threadCount) {}
+
+    ~UringEngine()
+    {
+        // The workers may still write to the eventfd until they are joined
+        m_pool.wait();
+        if (m_initialized)
+        {
+            io_uring_queue_exit(&m_ring);
+        }
+        if (m_eventFd >= 0)
+        {
+            close(m_eventFd);
+        }
+    }
+
+    bool init(unsigned queueDepth)
+    {
+        m_eventFd = eventfd(0, EFD_CLOEXEC);
+        m_initialized = m_eventFd >= 0 && io_uring_queue_init(queueDepth, &m_ring, 0) == 0;
+        return m_initialized;
+    }
+
+    virtual const char* name() const override { return "io_uring"; }
+
+    virtual void read(int fd, void* buffer, size_t size, uint64_t offset, IoCompletion done) override
+    {
+        io_uring_sqe* sqe = nextSqe();
+        io_uring_prep_read(sqe, fd, buffer, std::min<size_t>(size, maxRequestSize), offset);
+        io_uring_sqe_set_data(sqe, new IoCompletion(std::move(done)));
+        m_inFlight++;
+    }
+
+    virtual void write(int fd, const void* buffer, size_t size, uint64_t offset, IoCompletion done) override
+    {
+        io_uring_sqe* sqe = nextSqe();
+        io_uring_prep_write(sqe, fd, buffer, std::min<size_t>(size, maxRequestSize), offset);
+        io_uring_sqe_set_data(sqe, new IoCompletion(std::move(done)));
+        m_inFlight++;
+    }
+
+    virtual void runWork(std::function<void()> work, IoCompletion done) override
+    {
+        m_inFlight++;
+        m_workCount++;
+        if (!m_eventQueued)
+        {
+            queueEventRead();
+        }
+
+        m_pool.submit([this, work = std::move(work), done = std::move(done)]() mutable {
+            work();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_workDone.push_back(std::move(done));
+            }
+            uint64_t one = 1;
+            while (::write(m_eventFd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+        });
+    }
+
+    virtual bool poll() override
+    {
+        if (m_inFlight == 0)
+        {
+            return false;
+        }
+
+        int res;
+        do {
+            res = io_uring_submit_and_wait(&m_ring, 1);
+        } while (res == -EINTR);
+
+        // Reap everything first, the callbacks queue new requests into the same ring
+        std::vector<std::pair<IoCompletion*, ssize_t>> completed;
+        io_uring_cqe* cqe;
+        while (io_uring_peek_cqe(&m_ring, &cqe) == 0)
+        {
+            completed.emplace_back((IoCompletion*)io_uring_cqe_get_data(cqe), cqe->res);
+            io_uring_cqe_seen(&m_ring, cqe);
+        }
+
+        for (auto& completion: completed)
+        {
+            if (completion.first == nullptr)
+            {
+                completeWork();
+                continue;
+            }
+
+            std::unique_ptr<IoCompletion> done(completion.first);
+            m_inFlight--;
+            (*done)(completion.second);
+        }
+        return true;
+    }
+
+private:
+    // The length of a request is 32 bit, bigger transfers come back short and get continued by the caller
+    static constexpr size_t maxRequestSize = 1u << 30;
+
+    io_uring_sqe* nextSqe()
+    {
+        io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+        while (!sqe)
+        {
+            // The submission queue is full, hand it to the kernel to make room
+            io_uring_submit(&m_ring);
+            sqe = io_uring_get_sqe(&m_ring);
+        }
+        return sqe;
+    }
+
+    // The eventfd read is the one request without a callback
+    void queueEventRead()
+    {
+        io_uring_sqe* sqe = nextSqe();
+        io_uring_prep_read(sqe, m_eventFd, &m_eventValue, sizeof(m_eventValue), 0);
+        io_uring_sqe_set_data(sqe, nullptr);
+        m_eventQueued = true;
+    }
+
+    void completeWork()
+    {
+        m_eventQueued = false;
+
+        std::vector<IoCompletion> done;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            done.swap(m_workDone);
+        }
+
+        // Work finished after the swap has signaled the eventfd again, the next read picks it up
+        m_workCount -= done.size();
+        if (m_workCount > 0)
+        {
+            queueEventRead();
+        }
+
+        for (IoCompletion& completion: done)
+        {
+            m_inFlight--;
+            completion(0);
+        }
+    }
+
+    io_uring m_ring;
+    bool m_initialized{false};
+    size_t m_inFlight{0};   // requests and work, only touched by the polling thread
+
+    int m_eventFd{-1};
+    uint64_t m_eventValue{0};
+    bool m_eventQueued{false};
+    size_t m_workCount{0};
+
+    std::mutex m_mutex;
+    std::vector<IoCompletion> m_workDone;
+
+    // Last, so the workers are joined before what they report to goes away
+    WorkStealingPool m_pool;
+};
+
+#endif
+
+}
+
+std::unique_ptr<IoEngine> IoEngine::create(unsigned queueDepth, unsigned threadCount)
+{
+#ifdef WAVE_PATCHER_IO_URING
+    std::unique_ptr<UringEngine> engine(new UringEngine(threadCount));
+    if (engine->init(queueDepth))
+    {
+        return engine;
+    }
+#else
+    (void)queueDepth;
+#endif
+    // Kernels without io_uring, or with io_uring disabled by seccomp or sysctl, still get the same queue
+    return std::unique_ptr<IoEngine>(new ThreadPoolEngine(threadCount));
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <cstddef>
+#include <inttypes.h>
+#include <sys/types.h>
+
+// Called with the number of bytes transferred, or -errno
+using IoCompletion = std::function<void(ssize_t result)>;
+
+// Keeps many positional reads and writes in flight at once instead of blocking on each of them.
+// Requests are queued by read and write, poll waits for completions and runs their callbacks on the
+// calling thread, so one thread drives all the requests and the callbacks may queue new ones.
+// Like pread and pwrite a request may transfer less than asked for. The CPU work between the transfers
+// goes to worker threads through runWork, so the polling thread only submits and completes.
+class IoEngine
+{
+public:
+    virtual ~IoEngine() = default;
+
+    // io_uring when built with WAVE_PATCHER_IO_URING (link with -luring) and the kernel allows it,
+    // otherwise blocking calls on the workers. There are threadCount workers, 0 meaning one per core
+    static std::unique_ptr<IoEngine> create(unsigned queueDepth, unsigned threadCount);
+
+    virtual const char* name() const = 0;
+
+    virtual void read(int fd, void* buffer, size_t size, uint64_t offset, IoCompletion done) = 0;
+    virtual void write(int fd, const void* buffer, size_t size, uint64_t offset, IoCompletion done) = 0;
+
+    // Runs work on a worker thread, then done with 0 on the polling thread like the completion of a request
+    virtual void runWork(std::function<void()> work, IoCompletion done) = 0;
+
+    // Waits until at least one request has completed and runs the callbacks of all the completed ones.
+    // Returns false right away when nothing is in flight
+    virtual bool poll() = 0;
+};
@@ -1,34 +1,136 @@
 #include "iowave.h"
+#include "chunkcopy.h"
+#include "undojournal.h"
+#include "fileio.h"
+#include "mappedfile.h"
+#include "factory.h"
+#include "editscript.h"
 #include <iostream>
 #include <algorithm>
+#include <cstdio>
+#include <cstddef>
 
-bool IOWave::load(const char *fileName)
-{
-    m_chunks.resize(0);
-
-    std::ifstream file(fileName, std::ios_base::in | std::ios_base::binary);
+#include <fcntl.h>
+#include <unistd.h>
 
-    if (file.is_open())
+namespace
+{
+    // The target only gets its name once it's complete, so a failed save never leaves a file that looks valid,
+    // and a target that is the source stays readable while the passthrough chunks are copied from it
+    bool writeThroughPartFile(const char* fileName, const std::function<bool(const char*)>& write)
     {
-        file.read(&m_header.chunkID[0], sizeof(m_header));
+        std::string partFileName = std::string(fileName) + ".part";
 
-        if (strncmp(m_header.chunkID, "RIFF", 4) != 0)
+        if (!write(partFileName.c_str()))
+        {
+            std::remove(partFileName.c_str());
+            return false;
+        }
+        if (std::rename(partFileName.c_str(), fileName) != 0)
         {
-            std::cerr << "Input file is not a RIFF file" << std::endl;
+            std::cerr << "Can't replace the file \"" << fileName << "\"" << std::endl;
+            std::remove(partFileName.c_str());
             return false;
         }
+        return true;
+    }
+}
+
+bool IOWave::load(const char *fileName, bool metadataOnly)
+{
+    m_chunks.clear();
+    m_arena.release();
+    m_sourcePath = fileName;
+    m_streamTailSize = 0;
+    m_streamedToEnd = false;
+
+    if (m_inputBackend == InputBackend::Mmap)
+    {
+        return loadMapped(fileName, metadataOnly);
+    }
+    return loadStream(fileName, metadataOnly);
+}
+
+bool IOWave::checkHeader(uint64_t &remainingFileSize) const
+{
+    FourCC riffId = FourCC::fromBytes(m_header.chunkID);
+    if (riffId != "RIFF"_cc && riffId != "RF64"_cc && riffId != "BW64"_cc)
+    {
+        std::cerr << "Input file is not a RIFF file" << std::endl;
+        return false;
+    }
+
+    if (FourCC::fromBytes(m_header.riffType) != "WAVE"_cc)
+    {
+        std::cerr << "Input file is not a WAVE file" << std::endl;
+        return false;
+    }
+
+    // The real size of an RF64 file is only known from its ds64 chunk
+    if (isRf64())
+    {
+        remainingFileSize = UINT64_MAX;
+        return true;
+    }
+
+    if (m_header.dataSize.getInt() <= sizeof(m_header.riffType))
+    {
+        std::cerr << "Input file is an empty WAVE file" << std::endl;
+        return false;
+    }
+
+    remainingFileSize = m_header.dataSize.getInt() - sizeof(m_header.riffType);
+    return true;
+}
+
+bool IOWave::isRf64() const
+{
+    return FourCC::fromBytes(m_header.chunkID) != "RIFF"_cc;
+}
+
+const DataSize64ChunkData *IOWave::getDataSize64() const
+{
+    return isRf64() ? static_cast<const DataSize64ChunkData*>(findChunk("ds64"_cc)) : nullptr;
+}
 
-        if (strncmp(&(m_header.riffType[0]), "WAVE", 4) != 0)
+bool IOWave::addLoadedChunk(ChunkObject obj, uint64_t &remainingFileSize)
+{
+    if (isRf64() && m_chunks.empty())
+    {
+        if (obj.id != "ds64"_cc)
         {
-            std::cerr << "Input file is not a WAVE file" << std::endl;
+            std::cerr << "Input file is an RF64 file without a ds64 chunk" << std::endl;
             return false;
         }
 
-        uint32_t remainingFileSize = m_header.dataSize.getInt() - sizeof(m_header.riffType);
+        uint64_t riffSize = static_cast<const DataSize64ChunkData*>(obj.data.get())->getRiffSize();
+        remainingFileSize = riffSize > sizeof(m_header.riffType) ? riffSize - sizeof(m_header.riffType) : 0;
+    }
+
+    // A last chunk that claims more than the RIFF size ends the file instead of wrapping the count around
+    remainingFileSize -= std::min(remainingFileSize, obj.getDataSize());
+
+    if (m_traceInfo)
+    {
+        std::cout << "Found chunk \"" << obj.id << "\", size " << obj.getDataSize() << " bytes" << std::endl;
+    }
 
-        if (remainingFileSize <= 0)
+    bool raw = !obj.data->getSourceLocation() && !Factory::isDecodedOnLoad(obj.id);
+    m_chunks.append(std::move(obj), raw);
+    return true;
+}
+
+bool IOWave::loadStream(const char *fileName, bool metadataOnly)
+{
+    std::ifstream file(fileName, std::ios_base::in | std::ios_base::binary);
+
+    if (file.is_open())
+    {
+        file.read(&m_header.chunkID[0], sizeof(m_header));
+
+        uint64_t remainingFileSize;
+        if (!checkHeader(remainingFileSize))
         {
-            std::cerr << "Input file is an empty WAVE file" << std::endl;
             return false;
         }
 
@@ -37,15 +139,20 @@ bool IOWave::load(const char *fileName)
             std::cout << "Loading file \"" << fileName << "\"..." << std::endl;
         }
 
-        while (remainingFileSize > 0 && !file.eof())
+        while (remainingFileSize > 0 && file.peek() != std::ifstream::traits_type::eof())
         {
-            m_chunks.push_back(ChunkObject());
-            file >> m_chunks.back();
-            remainingFileSize -= m_chunks.back().getDataSize();
+            ChunkObject obj;
+            readChunkObject(file, obj, metadataOnly, &m_arena, getDataSize64());
+
+            if (file.fail())
+            {
+                std::cerr << "Input file is truncated" << std::endl;
+                break;
+            }
 
-            if (m_traceInfo)
+            if (!addLoadedChunk(std::move(obj), remainingFileSize))
             {
-                std::cout << "Found chunk \"" << m_chunks.back().data->getId() << "\", size " << m_chunks.back().getDataSize() << " bytes" << std::endl;
+                return false;
             }
         }
 
@@ -58,69 +165,914 @@ bool IOWave::load(const char *fileName)
     return false;
 }
 
-void IOWave::save(const char *fileName) const
+bool IOWave::loadMapped(const char *fileName, bool metadataOnly)
 {
-    std::ofstream file(fileName, std::ios_base::out | std::ios_base::binary);
+    std::shared_ptr<MappedFile> mapping = MappedFile::open(fileName);
 
-    if (file.is_open())
+    if (!mapping)
+    {
+        std::cerr << "Can't map the specified file \"" << fileName << "\"" << std::endl;
+        return false;
+    }
+
+    if (m_traceInfo)
+    {
+        std::cout << "Mapping file \"" << fileName << "\"..." << std::endl;
+    }
+
+    ByteReader file(mapping->data(), mapping->size(), mapping);
+    return loadFromReader(file, metadataOnly, mapping.get());
+}
+
+bool IOWave::loadFromMemory(const char *fileName, const uint8_t *data, size_t size, std::shared_ptr<const void> owner)
+{
+    m_chunks.clear();
+    m_arena.release();
+    m_sourcePath = fileName;
+    m_streamTailSize = 0;
+    m_streamedToEnd = false;
+
+    if (m_traceInfo)
     {
-        file.write(&m_header.chunkID[0], sizeof(m_header));
+        std::cout << "Loading file \"" << fileName << "\" from memory..." << std::endl;
+    }
+
+    ByteReader file(data, size, std::move(owner));
+    return loadFromReader(file, false, nullptr);
+}
+
+bool IOWave::loadFromReader(ByteReader &file, bool metadataOnly, const MappedFile *mapping)
+{
+    file.readBytes(&m_header.chunkID[0], sizeof(m_header));
+
+    uint64_t remainingFileSize;
+    if (!checkHeader(remainingFileSize))
+    {
+        return false;
+    }
 
-        for (const ChunkObject& obj: m_chunks)
+    while (remainingFileSize > 0 && !file.atEnd())
+    {
+        // Only the payloads that get decoded are worth reading ahead, the skipped ones are never touched
+        if (mapping && file.remaining() >= sizeof(ChunkHeader))
         {
-            file << obj;
+            ByteReader headerReader(file.data(), sizeof(ChunkHeader));
+            ChunkHeader next;
+            headerReader >> next;
+            if (!Factory::isKeptInFile(next, metadataOnly))
+            {
+                mapping->adviseWillNeed(file.position(), sizeof(ChunkHeader) + next.dataSize.getInt());
+            }
         }
 
-        file.close();
+        ChunkObject obj;
+        readChunkObject(file, obj, metadataOnly, &m_arena, getDataSize64());
+
+        if (file.failed())
+        {
+            std::cerr << "Input file is truncated" << std::endl;
+            break;
+        }
+
+        if (!addLoadedChunk(std::move(obj), remainingFileSize))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool IOWave::saveToMemory(std::vector<uint8_t> &output, const uint8_t *source, size_t sourceSize) const
+{
+    OutputPlan plan;
+    planOutput(0, 0, true, plan);
+
+    output.assign(plan.fileSize, 0);
+    for (const OutputPlan::Run& run: plan.runs)
+    {
+        memcpy(output.data() + run.targetOffset, plan.buffer.data() + run.bufferOffset, run.size);
+    }
+
+    for (const auto& copy: plan.copies)
+    {
+        const ChunkLocation* location = copy.first->data->getSourceLocation();
+        if (location->startOffset > sourceSize || location->size > sourceSize - location->startOffset)
+        {
+            std::cerr << "Chunk \"" << copy.first->data->getId() << "\" is outside of the source file" << std::endl;
+            return false;
+        }
+        memcpy(output.data() + copy.second, source + location->startOffset, location->size);
     }
+    return true;
+}
+
+bool IOWave::save(const char *fileName) const
+{
+    return writeThroughPartFile(fileName, [this](const char* partFileName) { return writeChunks(partFileName); });
+}
+
+void IOWave::planOutput(size_t first, uint64_t targetOffset, bool withHeader, OutputPlan &plan) const
+{
+    size_t bufferSize = withHeader ? sizeof(m_header) : 0;
+    for (size_t i = first; i < m_chunks.size(); i++)
+    {
+        const ChunkObject& obj = m_chunks[i];
+        const ChunkLocation* location = obj.data->getSourceLocation();
+        bufferSize += location ? sizeof(ChunkHeader) + location->size % 2 : obj.getDataSize();
+    }
+
+    plan.buffer.clear();
+    plan.buffer.reserve(bufferSize);
+    plan.runs.clear();
+    plan.copies.clear();
+
+    ByteWriter writer(plan.buffer);
+    size_t runStart = 0;
+    uint64_t runTargetOffset = targetOffset;
+
+    if (withHeader)
+    {
+        writer.writeBytes(&m_header.chunkID[0], sizeof(m_header));
+    }
+
+    for (size_t i = first; i < m_chunks.size(); i++)
+    {
+        const ChunkObject& obj = m_chunks[i];
+        const ChunkLocation* location = obj.data->getSourceLocation();
+
+        if (!location)
+        {
+            writer << obj;
+            continue;
+        }
+
+        // RF64 files give the size of the audio data only in their ds64 chunk
+        ChunkHeader header = obj.data->getHeader();
+        if (obj.id == "data"_cc && isRf64())
+        {
+            header.dataSize = oversizedChunkSize;
+        }
+        writer << header;
+
+        uint64_t payloadOffset = runTargetOffset + (writer.size() - runStart);
+        plan.runs.push_back(OutputPlan::Run{runStart, writer.size() - runStart, runTargetOffset});
+        plan.copies.emplace_back(&obj, payloadOffset);
+
+        runStart = writer.size();
+        runTargetOffset = payloadOffset + location->size;
+
+        if (location->size % 2 != 0)
+        {
+            writer.writeZeros(1);
+        }
+    }
+
+    if (writer.size() > runStart)
+    {
+        plan.runs.push_back(OutputPlan::Run{runStart, writer.size() - runStart, runTargetOffset});
+    }
+    plan.fileSize = runTargetOffset + (writer.size() - runStart);
+}
+
+bool IOWave::writeRuns(int fd, const OutputPlan &plan)
+{
+    for (const OutputPlan::Run& run: plan.runs)
+    {
+        if (!writeAll(fd, plan.buffer.data() + run.bufferOffset, run.size, run.targetOffset))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Writes the serialized header and in memory chunks with one positional write per run,
+// then lets ChunkCopier fill the gaps straight from the source file
+bool IOWave::writeChunks(const char *fileName) const
+{
+    OutputPlan plan;
+    planOutput(0, 0, true, plan);
+
+    int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+    {
+        std::cerr << "Can't open the specified file \"" << fileName << "\"" << std::endl;
+        return false;
+    }
+
+    // Sizing the file up front also covers a last payload that no run reaches
+    bool written = ftruncate(fd, plan.fileSize) == 0 && writeRuns(fd, plan);
+    close(fd);
+
+    if (!written)
+    {
+        std::cerr << "Error writing the file \"" << fileName << "\"" << std::endl;
+        return false;
+    }
+
+    if (plan.copies.empty())
+    {
+        return true;
+    }
+
+    ChunkCopier copier(m_sourcePath.c_str(), fileName);
+    if (!copier.isOpen())
+    {
+        std::cerr << "Can't open the source file \"" << m_sourcePath << "\"" << std::endl;
+        return false;
+    }
+
+    return copyPayloads(copier, plan, nullptr);
+}
+
+bool IOWave::copyPayloads(ChunkCopier &copier, const OutputPlan &plan, const ChunkObject *skipped) const
+{
+    for (const auto& copy: plan.copies)
+    {
+        if (copy.first == skipped)
+        {
+            continue;
+        }
+
+        CopyStats stats = copier.copy(*copy.first->data->getSourceLocation(), copy.second);
+
+        if (m_traceInfo)
+        {
+            std::cout << "Copied chunk \"" << copy.first->data->getId() << "\": " << stats << std::endl;
+        }
+
+        if (!stats.succeeded)
+        {
+            std::cerr << "Can't copy chunk \"" << copy.first->data->getId() << "\" from the source file" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool IOWave::saveWhileScanning(const char *fileName, const std::function<void (const uint8_t *, size_t)> &scan,
+                               const std::function<void (IOWave &)> &finish)
+{
+    size_t dataIndex = m_chunks.find("data"_cc);
+    if (dataIndex == ChunkTable::npos || !m_chunks[dataIndex].data->getSourceLocation())
+    {
+        finish(*this);
+        return save(fileName);
+    }
+
+    prepareScanLayout();
+
+    return writeThroughPartFile(fileName, [&](const char* partFileName) { return writeScanning(partFileName, scan, finish); });
+}
+
+// The data chunk is written where it's planned before the metadata is known, nothing in front of it may change size:
+// the cue and LIST chunks, which are rewritten, go behind it, and a file that may outgrow 4 GB gets a JUNK chunk
+// in front that a ds64 chunk takes over
+void IOWave::prepareScanLayout()
+{
+    for (FourCC id: {"cue "_cc, "LIST"_cc})
+    {
+        size_t index = m_chunks.find(id);
+        if (index != ChunkTable::npos && index < m_chunks.find("data"_cc))
+        {
+            m_chunks.moveToEnd(index);
+        }
+    }
+
+    uint64_t ds64Size = DataSize64ChunkData().getDataSize();
+    bool reserved = !m_chunks.empty() && m_chunks[0].id == "JUNK"_cc && m_chunks[0].data->getDataSize() == ds64Size;
+    uint64_t riffSize = sizeof(m_header.riffType) + m_chunks.totalSize() + m_streamTailSize;
+
+    if (!isRf64() && !reserved && riffSize + scanMetadataHeadroom >= oversizedChunkSize)
+    {
+        ChunkObject junk(makeChunk<GeneralChunkData>(&m_arena, ChunkHeader("JUNK"_cc, ds64Size)));
+        std::vector<uint8_t> zeros(ds64Size);
+        ByteReader reader(zeros.data(), zeros.size());
+        junk.data->readDataFromBuffer(reader);
+        m_chunks.insert(0, std::move(junk));
+    }
+    updateRiffSize();
+}
+
+bool IOWave::writeScanning(const char *fileName, const std::function<void (const uint8_t *, size_t)> &scan,
+                           const std::function<void (IOWave &)> &finish)
+{
+    const ChunkData* data = m_chunks[m_chunks.find("data"_cc)].data.get();
+    ChunkLocation dataLocation = *data->getSourceLocation();
+
+    OutputPlan plan;
+    auto dataOffset = [&]() {
+        auto copy = std::find_if(plan.copies.begin(), plan.copies.end(), [&](const auto& c) { return c.first->data.get() == data; });
+        return copy->second;
+    };
+
+    planOutput(0, 0, true, plan);
+    uint64_t targetOffset = dataOffset();
+
+    int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "Can't open the specified file \"" << fileName << "\"" << std::endl;
+        return false;
+    }
+    close(fd);
+
+    ChunkCopier copier(m_sourcePath.c_str(), fileName);
+    if (!copier.isOpen())
+    {
+        std::cerr << "Can't open the source file \"" << m_sourcePath << "\"" << std::endl;
+        return false;
+    }
+
+    CopyStats stats = copier.copyThrough(dataLocation, targetOffset, scan);
+
+    if (m_traceInfo)
+    {
+        std::cout << "Copied chunk \"data\" while scanning it: " << stats << std::endl;
+    }
+
+    if (!stats.succeeded)
+    {
+        std::cerr << "Can't copy chunk \"data\" from the source file" << std::endl;
+        return false;
+    }
+
+    finish(*this);
+
+    planOutput(0, 0, true, plan);
+    if (dataOffset() != targetOffset)
+    {
+        std::cerr << "The metadata found in \"" << m_sourcePath << "\" outgrew the room kept for it" << std::endl;
+        return false;
+    }
+
+    fd = open(fileName, O_WRONLY);
+    bool written = fd >= 0 && ftruncate(fd, plan.fileSize) == 0 && writeRuns(fd, plan);
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    if (!written)
+    {
+        std::cerr << "Error writing the file \"" << fileName << "\"" << std::endl;
+        return false;
+    }
+
+    return copyPayloads(copier, plan, &m_chunks[m_chunks.find("data"_cc)]);
+}
+
+bool IOWave::saveInPlace() const
+{
+    const char* fileName = m_sourcePath.c_str();
+
+    // Find where the first chunk that has to be rewritten starts, everything before it stays as it is
+    uint64_t tailOffset = sizeof(m_header);
+    size_t first = 0;
+
+    while (first < m_chunks.size()
+           && m_chunks[first].sourceOffset == (int64_t)tailOffset
+           && m_chunks[first].id != "cue "_cc
+           && m_chunks[first].id != "LIST"_cc)
+    {
+        tailOffset += m_chunks[first].getDataSize();
+        first++;
+    }
+
+    // The ds64 chunk is rewritten where it is, so it has to take exactly the room it had in the file
+    if (first > 0 && m_chunks[0].id == "ds64"_cc)
+    {
+        bool sameSize = m_chunks.size() > 1 && m_chunks[0].sourceOffset >= 0 && m_chunks[1].sourceOffset >= 0
+                     && uint64_t(m_chunks[1].sourceOffset - m_chunks[0].sourceOffset) == m_chunks[0].getDataSize();
+        if (!sameSize)
+        {
+            std::cerr << "The ds64 chunk of \"" << fileName << "\" changed its size, the file can't be patched in place" << std::endl;
+            return false;
+        }
+    }
+
+    for (size_t i = first; i < m_chunks.size(); i++)
+    {
+        if (m_chunks[i].data->getSourceLocation())
+        {
+            std::cerr << "Chunk \"" << m_chunks[i].id << "\" follows the metadata in \"" << fileName
+                      << "\", the file can't be patched in place" << std::endl;
+            return false;
+        }
+    }
+
+    if (m_traceInfo)
+    {
+        std::cout << "Rewriting \"" << fileName << "\" from offset " << tailOffset << std::endl;
+    }
+
+    // The RIFF header and, in RF64 files, the ds64 chunk right after it are rewritten where they are
+    std::vector<uint8_t> head;
+    ByteWriter headWriter(head);
+    headWriter.writeBytes(&m_header.chunkID[0], sizeof(m_header));
+    if (first > 0 && m_chunks[0].id == "ds64"_cc)
+    {
+        headWriter << m_chunks[0];
+    }
+
+    if (!UndoJournal::record(fileName, tailOffset, head.size()))
+    {
+        return false;
+    }
+
+    OutputPlan plan;
+    planOutput(first, tailOffset, false, plan);
+
+    int fd = open(fileName, O_WRONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Can't open the specified file \"" << fileName << "\"" << std::endl;
+        UndoJournal::rollback(fileName);
+        return false;
+    }
+
+    bool written = ftruncate(fd, tailOffset) == 0
+                && writeRuns(fd, plan)
+                && writeAll(fd, head.data(), head.size(), 0)
+                && fsync(fd) == 0;
+    close(fd);
+
+    if (!written)
+    {
+        std::cerr << "Error writing the file \"" << fileName << "\", rolling back" << std::endl;
+        UndoJournal::rollback(fileName);
+        return false;
+    }
+
+    return UndoJournal::commit(fileName);
+}
+
+bool IOWave::loadStreamHead(int fd)
+{
+    m_chunks.clear();
+    m_arena.release();
+    m_sourcePath = "-";
+    m_streamTailSize = 0;
+    m_streamedToEnd = false;
+
+    auto head = std::make_shared<std::vector<uint8_t>>(sizeof(m_header));
+    if (readStream(fd, head->data(), head->size()) != head->size())
+    {
+        std::cerr << "Input stream is not a RIFF file" << std::endl;
+        return false;
+    }
+
+    // Whole chunks up to the header of the data chunk, the audio data is passed on later without holding it
+    while (true)
+    {
+        size_t offset = head->size();
+        head->resize(offset + sizeof(ChunkHeader));
+        if (readStream(fd, head->data() + offset, sizeof(ChunkHeader)) != sizeof(ChunkHeader))
+        {
+            std::cerr << "Input stream ends before the audio data" << std::endl;
+            return false;
+        }
+
+        ByteReader headerReader(head->data() + offset, sizeof(ChunkHeader));
+        ChunkHeader header;
+        headerReader >> header;
+        if (header.id == "data"_cc)
+        {
+            break;
+        }
+
+        uint64_t size = header.dataSize.getInt() + header.dataSize.getInt() % 2;
+        if (header.dataSize.getInt() == oversizedChunkSize || head->size() + size > streamHeadLimit)
+        {
+            std::cerr << "Chunk \"" << header.id << "\" is too big to be held back from the stream" << std::endl;
+            return false;
+        }
+
+        head->resize(head->size() + size);
+        if (readStream(fd, head->data() + offset + sizeof(ChunkHeader), size) != size)
+        {
+            std::cerr << "Input stream ends before the audio data" << std::endl;
+            return false;
+        }
+    }
+
+    ByteReader file(head->data(), head->size(), head);
+    if (!loadFromReader(file, false, nullptr))
+    {
+        return false;
+    }
+
+    size_t dataIndex = m_chunks.find("data"_cc);
+    if (dataIndex == ChunkTable::npos)
+    {
+        std::cerr << "Input stream has no audio data within its RIFF size" << std::endl;
+        return false;
+    }
+
+    // Nothing counts past the audio data when its size is unknown, otherwise the chunks after it are what's left
+    // of the RIFF size from the header
+    m_streamedToEnd = !isRf64() && m_chunks[dataIndex].data->getDataSize() == oversizedChunkSize;
+
+    uint64_t riffSize = isRf64() ? getDataSize64()->getRiffSize() : m_header.dataSize.getInt();
+    uint64_t headSize = sizeof(m_header.riffType) + m_chunks.totalSize();
+    m_streamTailSize = !m_streamedToEnd && riffSize > headSize ? riffSize - headSize : 0;
+    return true;
+}
+
+bool IOWave::saveStream(int inFd, int outFd, bool dropLateMetadata) const
+{
+    size_t dataIndex = m_chunks.find("data"_cc);
+    const ChunkLocation* location = m_chunks[dataIndex].data->getSourceLocation();
+
+    // The new metadata chunks follow the rest of the input, unless the audio data runs to its end
+    std::vector<uint8_t> buffer;
+    ByteWriter writer(buffer);
+    writer.writeBytes(&m_header.chunkID[0], sizeof(m_header));
+
+    for (size_t i = 0; i < m_chunks.size(); i++)
+    {
+        if (i < dataIndex || (i > dataIndex && m_streamedToEnd))
+        {
+            writer << m_chunks[i];
+        }
+    }
+
+    ChunkHeader dataHeader = m_chunks[dataIndex].data->getHeader();
+    if (isRf64() || m_streamedToEnd)
+    {
+        dataHeader.dataSize = oversizedChunkSize;
+    }
+    writer << dataHeader;
+
+    if (!writeStream(outFd, buffer.data(), buffer.size()))
+    {
+        std::cerr << "Error writing the output stream" << std::endl;
+        return false;
+    }
+
+    CopyStats stats = streamCopy(inFd, outFd, m_streamedToEnd ? UINT64_MAX : location->size + location->size % 2);
+
+    if (m_traceInfo)
+    {
+        std::cout << "Passed on the audio data: " << stats << std::endl;
+    }
+
+    if (!stats.succeeded)
+    {
+        std::cerr << "Can't pass on the audio data of the input stream" << std::endl;
+        return false;
+    }
+
+    // The first cue and LIST chunks of the input are the ones that were rewritten
+    bool cueSeen = m_chunks.find("cue "_cc) < dataIndex;
+    bool listSeen = m_chunks.find("LIST"_cc) < dataIndex;
+    uint64_t remaining = m_streamTailSize;
+    uint8_t headerBytes[sizeof(ChunkHeader)];
+    std::vector<uint8_t> headerBuffer;
+    headerBuffer.reserve(sizeof(ChunkHeader));
+
+    while (remaining >= sizeof(ChunkHeader))
+    {
+        if (readStream(inFd, headerBytes, sizeof(headerBytes)) != sizeof(headerBytes))
+        {
+            std::cerr << "Input stream is truncated" << std::endl;
+            return false;
+        }
+
+        ByteReader headerReader(headerBytes, sizeof(headerBytes));
+        ChunkHeader header;
+        headerReader >> header;
+
+        uint64_t size = header.dataSize.getInt();
+        if (size == oversizedChunkSize && isRf64())
+        {
+            size = getDataSize64()->getChunkSize(header.id);
+        }
+        size += size % 2;
+        remaining -= std::min<uint64_t>(remaining, sizeof(ChunkHeader) + size);
+
+        bool* seen = header.id == "cue "_cc ? &cueSeen : (header.id == "LIST"_cc ? &listSeen : nullptr);
+        bool replaced = seen && !*seen;
+
+        if (replaced)
+        {
+            *seen = true;
+            if (!dropLateMetadata)
+            {
+                std::cerr << "The \"" << header.id << "\" chunk of the input stream follows the audio data, "
+                          << "it can only be replaced, not changed" << std::endl;
+                return false;
+            }
+
+            // The RIFF size was written before the chunk showed up, so its room stays taken
+            header.id = "JUNK"_cc;
+        }
+
+        headerBuffer.clear();
+        ByteWriter headerWriter(headerBuffer);
+        headerWriter << header;
+        if (!writeStream(outFd, headerBuffer.data(), headerBuffer.size()))
+        {
+            std::cerr << "Error writing the output stream" << std::endl;
+            return false;
+        }
+
+        if (!replaced)
+        {
+            stats = streamCopy(inFd, outFd, size);
+        }
+        else
+        {
+            std::vector<uint8_t> payload(std::min<uint64_t>(size, 64 * 1024));
+            stats.succeeded = true;
+            for (uint64_t left = size; left > 0 && stats.succeeded; )
+            {
+                size_t count = std::min<uint64_t>(left, payload.size());
+                stats.succeeded = readStream(inFd, payload.data(), count) == count;
+                memset(payload.data(), 0, count);
+                stats.succeeded = stats.succeeded && writeStream(outFd, payload.data(), count);
+                left -= count;
+            }
+        }
+
+        if (!stats.succeeded)
+        {
+            std::cerr << "Can't pass on chunk \"" << header.id << "\" of the input stream" << std::endl;
+            return false;
+        }
+    }
+
+    if (m_streamedToEnd)
+    {
+        return true;
+    }
+
+    buffer.clear();
+    for (size_t i = dataIndex + 1; i < m_chunks.size(); i++)
+    {
+        writer << m_chunks[i];
+    }
+
+    if (!writeStream(outFd, buffer.data(), buffer.size()))
+    {
+        std::cerr << "Error writing the output stream" << std::endl;
+        return false;
+    }
+    return true;
 }
 
 void IOWave::clearPointsAndLabels()
 {
-    auto it = std::find_if(m_chunks.begin(), m_chunks.end(), [](const ChunkObject& obj) { return strncmp(obj.data->getId(), "cue ", 4) == 0; });
+    size_t index = m_chunks.find("cue "_cc);
+
+    if (index != ChunkTable::npos)
+    {
+        m_chunks.erase(index);
+    }
+
+    index = m_chunks.find("LIST"_cc);
+
+    if (index != ChunkTable::npos)
+    {
+        m_chunks.erase(index);
+    }
+    updateRiffSize();
+}
+
+void IOWave::updateRiffSize()
+{
+    if (m_streamedToEnd)
+    {
+        return;
+    }
+
+    uint64_t riffSize = sizeof(m_header.riffType) + m_chunks.totalSize() + m_streamTailSize;
+
+    if (isRf64() || riffSize >= oversizedChunkSize)
+    {
+        updateDataSize64();
+        m_header.dataSize = oversizedChunkSize;
+        return;
+    }
+    m_header.dataSize = riffSize;
+}
+
+void IOWave::updateDataSize64()
+{
+    size_t index = m_chunks.find("ds64"_cc);
+
+    if (index == ChunkTable::npos)
+    {
+        index = insertDataSize64();
+    }
+
+    size_t dataIndex = m_chunks.find("data"_cc);
+    uint64_t dataChunkSize = 0;
+    std::vector<std::pair<FourCC, uint64_t>> oversized;
 
-    if (it != m_chunks.end())
+    for (size_t i = 0; i < m_chunks.size(); i++)
     {
-        m_header.dataSize -= it->getDataSize();
-        m_chunks.erase(it);
+        uint64_t size = m_chunks[i].data->getDataSize();
+        if (i == dataIndex) {
+            dataChunkSize = size;
+        } else if (size >= oversizedChunkSize) {
+            oversized.emplace_back(m_chunks[i].id, size);
+        }
     }
 
-    it = std::find_if(m_chunks.begin(), m_chunks.end(), [](const ChunkObject& obj) { return strncmp(obj.data->getId(), "LIST", 4) == 0; });
+    const FormatChunkData* format = getFormat();
+    DataSize64ChunkData* ds64 = static_cast<DataSize64ChunkData*>(m_chunks.edit(index));
 
-    if (it != m_chunks.end())
+    ds64->setDataChunkSize(dataChunkSize);
+    ds64->setChunkSizes(oversized);
+    if (format && format->getBlockAlign() > 0)
     {
-        m_header.dataSize -= it->getDataSize();
-        m_chunks.erase(it);
+        ds64->setSampleCount(dataChunkSize / format->getBlockAlign());
     }
+    m_chunks.updateSize(index);
+
+    ds64->setRiffSize(sizeof(m_header.riffType) + m_chunks.totalSize() + m_streamTailSize);
+}
+
+size_t IOWave::insertDataSize64()
+{
+    if (m_traceInfo)
+    {
+        std::cout << "The file outgrows 4 GB, saving it as RF64" << std::endl;
+    }
+    memcpy(m_header.chunkID, "RF64", sizeof(m_header.chunkID));
+
+    ChunkObject obj(makeChunk<DataSize64ChunkData>(&m_arena));
+
+    // RF64 aware writers reserve the room for a ds64 chunk with a JUNK chunk at the start, which is taken over.
+    // That keeps the chunks after it where they are, so the file can still be patched in place
+    if (!m_chunks.empty() && m_chunks[0].id == "JUNK"_cc && m_chunks[0].data->getDataSize() == obj.data->getDataSize())
+    {
+        obj.sourceOffset = m_chunks[0].sourceOffset;
+        m_chunks.erase(0);
+    }
+    m_chunks.insert(0, std::move(obj));
+    return 0;
 }
 
 void IOWave::addLabel(const std::string &label, uint32_t cuePointOffset)
 {
-    int oldSize = 0;
+    addMarkers({Marker{cuePointOffset, label}}, MarkerMerging::MergeWithExisting);
+}
 
-    auto cueIt = std::find_if(m_chunks.begin(), m_chunks.end(), [](const ChunkObject& obj) { return strncmp(obj.data->getId(), "cue ", 4) == 0; });
+void IOWave::addMarkers(const std::vector<Marker> &markers, MarkerMerging merging)
+{
+    if (merging == MarkerMerging::ReplaceExisting)
+    {
+        clearPointsAndLabels();
+    }
 
-    if (cueIt == m_chunks.end()) {
-        m_chunks.emplace_back(new CueChunkData);
-        cueIt--;
-    } else {
-        oldSize += cueIt->getDataSize();
+    if (markers.empty())
+    {
+        return;
+    }
+
+    size_t cueIndex = m_chunks.find("cue "_cc);
+
+    if (cueIndex == ChunkTable::npos) {
+        cueIndex = m_chunks.append(makeChunk<CueChunkData>(&m_arena));
+    }
+    CueChunkData* cueData = static_cast<CueChunkData*>(m_chunks.edit(cueIndex));
+    cueData->reserve(cueData->getPoints().size() + markers.size());
+
+    std::vector<std::pair<uint32_t, const std::string*>> labels;
+    labels.reserve(markers.size());
+
+    for (const Marker& marker: markers)
+    {
+        uint32_t pointId = cueData->addPointIfAbsent(marker.frameOffset);
+        if (!marker.label.empty())
+        {
+            labels.emplace_back(pointId, &marker.label);
+        }
     }
-    CueChunkData* cueData = static_cast<CueChunkData*>(cueIt->data.get());
-    uint32_t pointId = cueData->addPointIfAbsent(cuePointOffset);
+    m_chunks.updateSize(cueIndex);
 
-    auto lstIt = std::find_if(m_chunks.begin(), m_chunks.end(), [](const ChunkObject& obj) { return strncmp(obj.data->getId(), "LIST", 4) == 0; });
+    size_t lstIndex = m_chunks.find("LIST"_cc);
+
+    if (lstIndex == ChunkTable::npos && !labels.empty()) {
+        lstIndex = m_chunks.append(makeChunk<ListChunkData>(&m_arena));
+    }
 
-    if (lstIt == m_chunks.end()) {
-        m_chunks.emplace_back(new ListChunkData);
-        lstIt--;
-    } else {
-        oldSize += lstIt->getDataSize();
+    if (lstIndex != ChunkTable::npos)
+    {
+        ListChunkData* listData = static_cast<ListChunkData*>(m_chunks.edit(lstIndex));
+        listData->setLabels(labels);
+        m_chunks.updateSize(lstIndex);
     }
-    ListChunkData* listData = static_cast<ListChunkData*>(lstIt->data.get());
-    listData->addData(new SubListChunkData(pointId, label));
 
-    m_header.dataSize += (cueIt->getDataSize() + lstIt->getDataSize() - oldSize);
+    updateRiffSize();
+}
+
+bool IOWave::applyEdits(const std::vector<EditOperation> &operations)
+{
+    size_t cueIndex = m_chunks.find("cue "_cc);
+    size_t lstIndex = m_chunks.find("LIST"_cc);
+
+    // The edits go to copies, so a failing operation leaves the loaded file as it was
+    CueChunkData cueData;
+    if (cueIndex != ChunkTable::npos)
+    {
+        cueData = *static_cast<const CueChunkData*>(m_chunks.view(cueIndex));
+    }
+
+    std::unordered_map<uint32_t, std::string> labels;
+    if (lstIndex != ChunkTable::npos)
+    {
+        for (const auto& label: static_cast<const ListChunkData*>(m_chunks.view(lstIndex))->getLabelsByCuePointId())
+        {
+            labels.emplace(label.first, std::string(label.second));
+        }
+    }
+    bool cleared = false;
+
+    for (const EditOperation& operation: operations)
+    {
+        switch (operation.type)
+        {
+        case EditOperation::Type::Add:
+            labels[cueData.addPointIfAbsent(operation.value)] = operation.label;
+            break;
+        case EditOperation::Type::Rename:
+            if (!cueData.findPoint(operation.value))
+            {
+                std::cerr << "Can't rename cue point " << operation.value << ", there's no such point" << std::endl;
+                return false;
+            }
+            labels[operation.value] = operation.label;
+            break;
+        case EditOperation::Type::Delete:
+            if (!cueData.removePoint(operation.value))
+            {
+                std::cerr << "Can't delete cue point " << operation.value << ", there's no such point" << std::endl;
+                return false;
+            }
+            labels.erase(operation.value);
+            break;
+        case EditOperation::Type::Shift:
+            if (!cueData.shiftPoints(operation.value))
+            {
+                std::cerr << "Can't shift the cue points by " << operation.value << " frames, a point would move out of range" << std::endl;
+                return false;
+            }
+            break;
+        case EditOperation::Type::Clear:
+            cueData.clear();
+            labels.clear();
+            cleared = true;
+            break;
+        }
+    }
+
+    if (cueIndex == ChunkTable::npos && !cueData.getPoints().empty())
+    {
+        cueIndex = m_chunks.append(makeChunk<CueChunkData>(&m_arena));
+    }
+
+    if (cueIndex != ChunkTable::npos)
+    {
+        *static_cast<CueChunkData*>(m_chunks.edit(cueIndex)) = std::move(cueData);
+        m_chunks.updateSize(cueIndex);
+    }
+
+    if (lstIndex == ChunkTable::npos && !labels.empty())
+    {
+        lstIndex = m_chunks.append(makeChunk<ListChunkData>(&m_arena));
+    }
+
+    if (lstIndex != ChunkTable::npos)
+    {
+        ListChunkData* listData = static_cast<ListChunkData*>(m_chunks.edit(lstIndex));
+        if (cleared)
+        {
+            listData->clear();
+        }
+        listData->replaceLabels(labels);
+        m_chunks.updateSize(lstIndex);
+    }
+
+    // Like after clearPointsAndLabels, a file without cue points has no cue or LIST chunks left.
+    // The LIST chunk is looked up again, erasing the cue chunk may have moved it
+    cueIndex = m_chunks.find("cue "_cc);
+    if (cleared && cueIndex != ChunkTable::npos && static_cast<const CueChunkData*>(m_chunks.view(cueIndex))->getPoints().empty())
+    {
+        m_chunks.erase(cueIndex);
+    }
+    lstIndex = m_chunks.find("LIST"_cc);
+    if (cleared && lstIndex != ChunkTable::npos && static_cast<const ListChunkData*>(m_chunks.view(lstIndex))->getChunks().empty())
+    {
+        m_chunks.erase(lstIndex);
+    }
+
+    updateRiffSize();
+    return true;
 }
 
 void IOWave::debugPrint() const
@@ -128,6 +1080,100 @@ void IOWave::debugPrint() const
     std::cout << "data size:" << m_header.dataSize.getInt() << ", chunks:\n";
     for (const ChunkObject& obj: m_chunks)
     {
-        std::cout << "id: " << obj.data->getId() << ", size: " << obj.getDataSize() << std::endl;
+        std::cout << "id: " << obj.id << ", size: " << obj.getDataSize() << std::endl;
+    }
+}
+
+const ChunkData *IOWave::findChunk(FourCC id) const
+{
+    size_t index = m_chunks.find(id);
+    return index != ChunkTable::npos ? m_chunks.view(index) : nullptr;
+}
+
+const FormatChunkData *IOWave::getFormat() const
+{
+    return static_cast<const FormatChunkData*>(findChunk("fmt "_cc));
+}
+
+const CueChunkData *IOWave::getCuePoints() const
+{
+    return static_cast<const CueChunkData*>(findChunk("cue "_cc));
+}
+
+const ListChunkData *IOWave::getLabels() const
+{
+    // An INFO list may come first, the labels are in the adtl one
+    for (size_t i = 0; i < m_chunks.size(); i++)
+    {
+        if (m_chunks[i].id == "LIST"_cc)
+        {
+            const ListChunkData* list = static_cast<const ListChunkData*>(m_chunks.view(i));
+            if (list->getTypeId() == "adtl"_cc)
+            {
+                return list;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void IOWave::printInfo(std::ostream &os) const
+{
+    os << "File \"" << m_sourcePath << "\"\n";
+
+    const FormatChunkData* format = getFormat();
+    if (format)
+    {
+        os << "Format: compression code " << format->getCompressionCode()
+           << ", " << format->getNumberOfChannels() << " channels"
+           << ", " << format->getSampleRate() << " Hz"
+           << ", " << format->getSignificantBitsPerSample() << " bits"
+           << ", block align " << format->getBlockAlign()
+           << ", " << format->getAverageBytesPerSecond() << " bytes/s\n";
+    }
+
+    const ChunkData* data = findChunk("data"_cc);
+    if (data)
+    {
+        os << "Data: " << data->getDataSize() << " bytes";
+        if (format && format->getBlockAlign() > 0 && format->getSampleRate() > 0)
+        {
+            uint64_t frames = data->getDataSize() / format->getBlockAlign();
+            os << ", " << frames << " frames, " << (double)frames / format->getSampleRate() << " s";
+        }
+        os << "\n";
+    }
+
+    os << "Chunks:";
+    for (const ChunkObject& obj: m_chunks)
+    {
+        os << " \"" << obj.id << "\" " << obj.data->getDataSize();
+    }
+    os << "\n";
+
+    const CueChunkData* cue = getCuePoints();
+    const ListChunkData* list = getLabels();
+
+    std::unordered_map<uint32_t, std::string_view> labels;
+    if (list)
+    {
+        labels = list->getLabelsByCuePointId();
+    }
+
+    os << "Cue points: " << (cue ? cue->getPoints().size() : 0) << "\n";
+    if (cue)
+    {
+        for (const CuePointData& p: cue->getPoints())
+        {
+            os << "  " << p.cuePointID << ": frame " << p.frameOffset;
+
+            auto it = labels.find(p.cuePointID);
+            if (it != labels.end())
+            {
+                os << " \"" << it->second << "\"";
+            }
+            os << "\n";
+        }
     }
+    os.flush();
 }
@@ -1,23 +1,140 @@
 #pragma once
 
 #include "wavdata.h"
-#include <list>
+#include "chunktable.h"
+#include "markers.h"
+
+#include <functional>
+
+class MappedFile;
+class ChunkCopier;
+struct EditOperation;
+
+enum class InputBackend {
+    Stream,     // every chunk that gets decoded is read into a buffer of its own
+    Mmap        // the file is mapped, chunks are decoded from the mapping and unknown ones refer to it
+};
 
 class IOWave
 {
 public:
-    IOWave(bool traceInfo = false): m_traceInfo(traceInfo) {}
+    IOWave(bool traceInfo = false, InputBackend inputBackend = InputBackend::Stream)
+        : m_traceInfo(traceInfo), m_inputBackend(inputBackend) {}
+
+    // With metadataOnly only the chunk headers and the fmt, cue and LIST chunks are read,
+    // the rest is skipped, so the result is good for inspecting but not for saving
+    bool load(const char* fileName, bool metadataOnly = false);
+    // Writes to fileName.part and renames it to fileName when it's complete, a failed save leaves no target
+    bool save(const char* fileName) const;
+
+    // Saves while metadata is worked out from the audio data: the data chunk is copied through a buffer that scan
+    // sees piece by piece, then finish changes the metadata and the rest of the file is written. The cue and LIST
+    // chunks are moved behind the data chunk first, so the audio data is written only once
+    bool saveWhileScanning(const char* fileName, const std::function<void(const uint8_t*, size_t)>& scan,
+                           const std::function<void(IOWave&)>& finish);
 
-    bool load(const char* fileName);
-    void save(const char* fileName) const;
+    // For callers that do their own I/O: decodes a whole file that is already in memory, owner keeps the bytes
+    // alive for the chunks that refer to them. saveToMemory serializes the whole output, the payloads that
+    // stayed in the source are taken from the same bytes
+    bool loadFromMemory(const char* fileName, const uint8_t* data, size_t size, std::shared_ptr<const void> owner);
+    bool saveToMemory(std::vector<uint8_t>& output, const uint8_t* source, size_t sourceSize) const;
+
+    // Rewrites the loaded file itself: keeps the unchanged chunks at the beginning of the file and only
+    // writes what follows them plus the RIFF size. Works when the metadata chunks are at the end of the file
+    bool saveInPlace() const;
+
+    // For pipelines: loadStreamHead reads the chunks up to the audio data from fd, which may be a pipe, the audio
+    // data and everything after it stay in the input. saveStream then writes the whole output to outFd in one pass,
+    // passing the rest of the input on as it arrives. A cue or LIST chunk that only shows up after the audio data
+    // has been replaced already, it becomes a JUNK chunk of the same size unless dropLateMetadata is false,
+    // which makes it an error
+    bool loadStreamHead(int fd);
+    bool saveStream(int inFd, int outFd, bool dropLateMetadata) const;
 
     void clearPointsAndLabels();
     void addLabel(const std::string& label, uint32_t cuePointOffset);
 
+    // Adds all the markers as one batch, the cue and LIST chunks are looked up and the RIFF size is updated once
+    void addMarkers(const std::vector<Marker>& markers, MarkerMerging merging);
+
+    // Applies the operations in order to the cue points and labels and updates the RIFF size once at the end.
+    // Nothing is changed if an operation refers to a missing cue point
+    bool applyEdits(const std::vector<EditOperation>& operations);
+
     void debugPrint() const;
+
+    // Format, chunk layout, cue points and labels
+    void printInfo(std::ostream& os) const;
+
+    const FormatChunkData* getFormat() const;
+    const CueChunkData* getCuePoints() const;
+    const ListChunkData* getLabels() const;
+    const ChunkData* findChunk(FourCC id) const;
+    const ChunkTable& getChunks() const { return m_chunks; }
 private:
+    // Enough for the metadata chunks of a typical file without going back to the heap
+    static constexpr size_t arenaInitialSize = 16 * 1024;
+
+    // Files this close to 4 GB keep room for a ds64 chunk when their metadata is only known after the audio data
+    static constexpr uint64_t scanMetadataHeadroom = 64 * 1024 * 1024;
+
+    // The chunks before the audio data of a stream are held in memory, this much of them at most
+    static constexpr size_t streamHeadLimit = 64 * 1024 * 1024;
+
+    // The in memory parts of the output serialized into one buffer, and where each piece goes in the target file.
+    // Passthrough payloads leave gaps between the runs that are filled by copying from the source file
+    struct OutputPlan {
+        struct Run {
+            size_t bufferOffset;
+            size_t size;
+            uint64_t targetOffset;
+        };
+
+        std::vector<uint8_t> buffer;
+        std::vector<Run> runs;
+        std::vector<std::pair<const ChunkObject*, uint64_t>> copies;
+        uint64_t fileSize{0};
+    };
+
+    // Plans the chunks from index first on
+    void planOutput(size_t first, uint64_t targetOffset, bool withHeader, OutputPlan& plan) const;
+    static bool writeRuns(int fd, const OutputPlan& plan);
+
+    bool writeChunks(const char* fileName) const;
+    bool copyPayloads(ChunkCopier& copier, const OutputPlan& plan, const ChunkObject* skipped) const;
+    void prepareScanLayout();
+    bool writeScanning(const char* fileName, const std::function<void(const uint8_t*, size_t)>& scan,
+                       const std::function<void(IOWave&)>& finish);
+
+    // The RIFF size follows from the chunks, there's no separate count to keep in step with them.
+    // Files that need 64 bit sizes are RF64 files with the sizes in their ds64 chunk, a RIFF file that
+    // grows past 4 GB becomes one
+    void updateRiffSize();
+    void updateDataSize64();
+    size_t insertDataSize64();
+
+    bool isRf64() const;
+    const DataSize64ChunkData* getDataSize64() const;
+
+    bool checkHeader(uint64_t& remainingFileSize) const;
+    bool addLoadedChunk(ChunkObject obj, uint64_t& remainingFileSize);
+    bool loadStream(const char* fileName, bool metadataOnly);
+    bool loadMapped(const char* fileName, bool metadataOnly);
+    bool loadFromReader(ByteReader& file, bool metadataOnly, const MappedFile* mapping);
+
     WaveHeader m_header;
-    std::list<ChunkObject> m_chunks;
+
+    // Backs the chunks and their tables and texts. Declared before m_chunks, so it outlives them;
+    // loading another file destroys the chunks and hands all their memory back in one go
+    std::pmr::monotonic_buffer_resource m_arena{arenaInitialSize};
+    ChunkTable m_chunks{&m_arena};
+    std::string m_sourcePath;
+
+    // A stream passes on the chunks after its audio data without loading them, they still count for the RIFF size.
+    // Writers that can't seek leave the sizes unknown and the audio data runs to the end of the stream
+    uint64_t m_streamTailSize{0};
+    bool m_streamedToEnd{false};
 
     bool m_traceInfo;
+    InputBackend m_inputBackend;
 };
@@ -4,14 +4,28 @@
 #include <type_traits>
 #include <fstream>
 #include <vector>
+#include <cstring>
 
-enum class EHostEndianness {
-    Undefined = 0,
-    LittleEndian,
-    BigEndian
-};
+// Known at compile time, so the conversions below reduce to a plain load and store, or a bswap on big endian hosts.
+// GCC and Clang tell the byte order, MSVC only targets little endian hosts
+constexpr bool isHostLittleEndian()
+{
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+    return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+#else
+    return true;
+#endif
+}
 
-bool isHostLittleEndian();
+// True while the compiler evaluates a constant expression, where memcpy isn't allowed
+constexpr bool isConstantEvaluated()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_is_constant_evaluated();
+#else
+    return true;
+#endif
+}
 
 // Some Structs that we use to represent and manipulate Chunks in the Wave files
 
@@ -24,80 +38,72 @@ struct LittleEndianInt<T, true>
     static const int bytes_count = sizeof(T);
     uint8_t data[bytes_count] = {0};
 
-    LittleEndianInt() = default;
-    LittleEndianInt(const LittleEndianInt<T, true>&) = default;
+    constexpr LittleEndianInt() = default;
+    constexpr LittleEndianInt(const LittleEndianInt<T, true>&) = default;
 
-    LittleEndianInt(T value)
+    constexpr LittleEndianInt(T value)
     {
         setInt(value);
     }
 
-    LittleEndianInt<T, true>& operator=(T value )
+    constexpr LittleEndianInt<T, true>& operator=(T value )
     {
         setInt(value);
         return *this;
     }
 
-    void setInt(T value)
+    // Shifts instead of copying bytes through a pointer, which the compiler merges into one store
+    constexpr void setInt(T value)
     {
-        uint8_t* uintValueBytes = (uint8_t *)&value;
+        using Unsigned = typename std::make_unsigned<T>::type;
 
-        if (isHostLittleEndian())
+        for (int i = 0; i < bytes_count; ++i)
         {
-            for (int i = 0; i < bytes_count; ++i)
-            {
-                data[i] = uintValueBytes[i];
-            }
-        }
-        else
-        {
-            for (int i = 0; i < bytes_count; ++i)
-            {
-                data[i] = uintValueBytes[bytes_count - 1 - i];
-            }
+            data[i] = uint8_t(Unsigned(value) >> (8 * i));
         }
     }
 
-    T getInt() const
+    constexpr T getInt() const
     {
-        T value;
-        uint8_t *uintValueBytes = (uint8_t *)&value;
-
-        if (isHostLittleEndian())
+        // Not every compiler merges the byte loads below, a memcpy always becomes a single load
+        if constexpr (isHostLittleEndian())
         {
-            for (int i = 0; i < bytes_count; ++i)
+            if (!isConstantEvaluated())
             {
-                uintValueBytes[i] = data[i];
+                T value = 0;
+                memcpy(&value, data, sizeof(T));
+                return value;
             }
         }
-        else
+
+        using Unsigned = typename std::make_unsigned<T>::type;
+        Unsigned value = 0;
+
+        for (int i = 0; i < bytes_count; ++i)
         {
-            for (int i = 0; i < bytes_count; ++i)
-            {
-                uintValueBytes[i] = data[bytes_count - 1 - i];
-            }
+            value |= Unsigned(data[i]) << (8 * i);
         }
 
-        return value;
+        return T(value);
     }
 
-    LittleEndianInt<T, true> operator+(LittleEndianInt<T, true> other) const
+    constexpr LittleEndianInt<T, true> operator+(LittleEndianInt<T, true> other) const
     {
         return LittleEndianInt<T, true>(getInt() + other.getInt());
     }
 
-    LittleEndianInt<T, true> operator-(LittleEndianInt<T, true> other) const
+    constexpr LittleEndianInt<T, true> operator-(LittleEndianInt<T, true> other) const
     {
         return LittleEndianInt<T, true>(getInt() - other.getInt());
     }
 
-    LittleEndianInt<T, true>& operator+=(LittleEndianInt<T, true> other)
+    constexpr LittleEndianInt<T, true>& operator+=(LittleEndianInt<T, true> other)
     {
         *this = *this + other;
         return *this;
     }
 
-    LittleEndianInt<T, true>& operator-=(LittleEndianInt<T, true> other)
+    constexpr LittleEndianInt<T, true>& operator-=(LittleEndianInt<T, true> other)
     {
         *this = *this - other;
         return *this;
@@ -118,11 +124,15 @@ std::ifstream& operator>>(std::ifstream& is, LittleEndianInt<T>& data) {
 
 using LittleEndianInt16 = LittleEndianInt<uint16_t>;
 using LittleEndianInt32 = LittleEndianInt<uint32_t>;
+using LittleEndianInt64 = LittleEndianInt<uint64_t>;
+
+static_assert(LittleEndianInt32(0x12345678).data[0] == 0x78 && LittleEndianInt32(0x12345678).getInt() == 0x12345678,
+              "LittleEndianInt must store the least significant byte first");
 
 // The header of a wave file
 struct WaveHeader {
-    char chunkID[4] = {'R','I','F','F'};		// Must be "RIFF" (0x52494646)
-    LittleEndianInt32 dataSize;		// Byte count for the rest of the file (i.e. file length - 8 bytes)
+    char chunkID[4] = {'R','I','F','F'};		// Must be "RIFF" (0x52494646), or "RF64"/"BW64" for files with a ds64 chunk
+    LittleEndianInt32 dataSize;		// Byte count for the rest of the file (i.e. file length - 8 bytes), 0xFFFFFFFF in RF64 files
     char riffType[4] = {'W','A','V','E'};	// Must be "WAVE" (0x57415645)
 };
 
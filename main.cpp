@@ -1,36 +1,58 @@
 
 #include <iostream>
 #include <cstring>
-#include "wavdata.h"
-#include "iowave.h"
+#include <cstdlib>
+#include "patcher.h"
+#include "batch.h"
+#include "metadataexport.h"
+#include "splitter.h"
+#include "concatenator.h"
+#include <fstream>
+#include <vector>
 
 
-std::string fileNameFromPath(const std::string& path)
-{
-    size_t slashIndex = path.find_last_of("/\\");
-    size_t dotIndex = path.find_last_of('.');
-    size_t index1 = (slashIndex == std::string::npos) ? 0 : slashIndex + 1;
-    size_t index2 = (dotIndex == std::string::npos) ? path.size() : dotIndex;
-
-    return path.substr(index1, index2 - index1);
-}
-
-void patchFile(const char* sourcePath, const char* targetPath, bool traceInfo)
-{
-    IOWave ioObj(traceInfo);
-
-    if (ioObj.load(sourcePath))
-    {
-        ioObj.clearPointsAndLabels();
-        auto fileName = fileNameFromPath(sourcePath);
-        ioObj.addLabel(fileName.c_str(), 0);
-        ioObj.save(targetPath);
-    }
-}
-
 void printHelp(const char* execPath)
 {
-    std::cout << "Help:\n" << fileNameFromPath(execPath) << " <sourcePath> <targetPath> [-t]\n    -t: trace debug" << std::endl;
+    std::string name = fileNameFromPath(execPath);
+    std::cout << "Help:\n" << name << " <sourcePath> <targetPath> [--markers <markersPath> [--merge]] [--edit <scriptPath>]\n"
+              << "    [--auto-markers [--silence <dB>] [--min-silence <seconds>]] [--mmap] [-t]\n"
+              << name << " - - [--markers <markersPath> [--merge]] [--edit <scriptPath>]\n"
+              << name << " --in-place <path> [--markers <markersPath> [--merge]] [--edit <scriptPath>] [--auto-markers] [--mmap] [-t]\n"
+              << name << " --batch <manifest> [--markers <markersPath> [--merge]] [--edit <scriptPath>] [--async-io] [-j <threads>] [-t]\n"
+              << name << " --batch-dir <sourceDir> <targetDir> [--markers <markersPath> [--merge]] [--edit <scriptPath>] [--async-io] [-j <threads>] [-t]\n"
+              << name << " --batch-dir <dir> --in-place [--markers <markersPath> [--merge]] [--edit <scriptPath>] [-j <threads>] [-t]\n"
+              << name << " --info <path>... [-t]\n"
+              << name << " --split <path> <targetDir> [--mmap] [-t]\n"
+              << name << " --concat <path>... -o <targetPath> [--mmap] [-j <threads>] [-t]\n"
+              << name << " --export <dir> [--csv] [-o <outputPath>] [-j <threads>]\n"
+              << "    -t: trace debug\n"
+              << "    --mmap: map the source file instead of reading it, the chunks are decoded from the mapping\n"
+              << "    -: read the source from stdin or write the target to stdout, in one pass for pipelines. Only the cue\n"
+              << "       and LIST chunks before the audio data can be merged or edited, -t traces only to a target file\n"
+              << "    --in-place: rewrite only the metadata at the end of the file, an interrupted run is rolled back on the next one\n"
+              << "    --markers: set the cue points and labels from a file instead of a single label named after the file,\n"
+              << "               one \"<frameOffset>[\\t<label>]\" per line\n"
+              << "    --merge: keep the existing cue points and labels, markers at the offset of an existing point relabel it\n"
+              << "    --edit: apply the operations of a script to the cue points and labels, one per line, in order:\n"
+              << "            \"add <frameOffset> <label>\", \"rename <cuePointId> <label>\", \"delete <cuePointId>\",\n"
+              << "            \"shift <frames>\", \"clear\"\n"
+              << "    --auto-markers: add a cue point labeled \"sound <n>\" where the sound starts after silence, found while the\n"
+              << "                    audio data is copied, for 16/24/32 bit integer and 32 bit float PCM. Also with the batch modes\n"
+              << "    --silence: level in dBFS up to which a 10 ms window counts as silent, -50 by default\n"
+              << "    --min-silence: seconds of silence before a new cue point, 0.5 by default\n"
+              << "    --batch: patch every file of the manifest, one \"<sourcePath>\\t<targetPath>\" per line,\n"
+              << "             or \"<path>\" to patch that file in place\n"
+              << "    --batch-dir: patch every .wav file under the directory\n"
+              << "    --async-io: read and write the small files of a batch with many requests in flight, on io_uring when built\n"
+              << "                with it, the big files and the in place patches are done the usual way\n"
+              << "    -j: number of worker threads for the batch modes, all cores by default\n"
+              << "    --info: print the format, the chunks, the cue points and the labels, skipping the audio data\n"
+              << "    --split: write one file per region between consecutive cue points to the directory, named after the\n"
+              << "             label of the point it starts at, the audio data is copied or reflinked without decoding it\n"
+              << "    --concat: join the audio data of files of the same format into the output file, with a cue point\n"
+              << "              labeled with the file name where each of them starts\n"
+              << "    --export: write the metadata of every .wav file under the directory as JSON lines, or CSV with --csv,\n"
+              << "              to the output file or stdout, sorted by path" << std::endl;
 }
 
 int main(int argc, char *argv[])
@@ -43,27 +65,242 @@ int main(int argc, char *argv[])
             printHelp(argv[0]);
             return 0;
         }
-        if (argc > 4)
+        PatchOptions options;
+        bool inPlace = false;
+        const char* manifestPath = nullptr;
+        bool batchDir = false;
+        bool asyncIo = false;
+        bool info = false;
+        bool split = false;
+        bool concat = false;
+        bool exportLibrary = false;
+        bool csv = false;
+        const char* outputPath = nullptr;
+        const char* markersPath = nullptr;
+        const char* editScriptPath = nullptr;
+        unsigned threadCount = 0;
+        bool autoMarkers = false;
+        AutoMarkerSettings autoMarkerSettings;
+        std::vector<const char*> paths;
+
+        for (int i = 1; i < argc; i++)
+        {
+            if (strcmp(argv[i], "-t") == 0)
+            {
+                options.traceInfo = true;
+            }
+            else if (strcmp(argv[i], "--mmap") == 0)
+            {
+                options.inputBackend = InputBackend::Mmap;
+            }
+            else if (strcmp(argv[i], "--in-place") == 0)
+            {
+                inPlace = true;
+            }
+            else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+            {
+                manifestPath = argv[++i];
+            }
+            else if (strcmp(argv[i], "--async-io") == 0)
+            {
+                asyncIo = true;
+            }
+            else if (strcmp(argv[i], "--batch-dir") == 0)
+            {
+                batchDir = true;
+            }
+            else if (strcmp(argv[i], "--info") == 0)
+            {
+                info = true;
+            }
+            else if (strcmp(argv[i], "--split") == 0)
+            {
+                split = true;
+            }
+            else if (strcmp(argv[i], "--concat") == 0)
+            {
+                concat = true;
+            }
+            else if (strcmp(argv[i], "--export") == 0)
+            {
+                exportLibrary = true;
+            }
+            else if (strcmp(argv[i], "--csv") == 0)
+            {
+                csv = true;
+            }
+            else if (strcmp(argv[i], "--markers") == 0 && i + 1 < argc)
+            {
+                markersPath = argv[++i];
+            }
+            else if (strcmp(argv[i], "--edit") == 0 && i + 1 < argc)
+            {
+                editScriptPath = argv[++i];
+            }
+            else if (strcmp(argv[i], "--auto-markers") == 0)
+            {
+                autoMarkers = true;
+            }
+            else if (strcmp(argv[i], "--silence") == 0 && i + 1 < argc)
+            {
+                autoMarkerSettings.silenceThresholdDb = std::strtod(argv[++i], nullptr);
+            }
+            else if (strcmp(argv[i], "--min-silence") == 0 && i + 1 < argc)
+            {
+                autoMarkerSettings.minSilenceSeconds = std::strtod(argv[++i], nullptr);
+            }
+            else if (strcmp(argv[i], "--merge") == 0)
+            {
+                options.markerMerging = MarkerMerging::MergeWithExisting;
+            }
+            else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            {
+                outputPath = argv[++i];
+            }
+            else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            {
+                threadCount = std::strtoul(argv[++i], nullptr, 10);
+            }
+            else if (argv[i][0] == '-' && argv[i][1] != '\0')
+            {
+                std::cout << "Unknown parameter passed \"" << argv[i] << "\"" << std::endl;
+                return 0;
+            }
+            else
+            {
+                paths.push_back(argv[i]);
+            }
+        }
+
+        if (info)
+        {
+            if (paths.empty())
+            {
+                std::cout << "No enough arguments" << std::endl;
+                printHelp(argv[0]);
+                return 0;
+            }
+
+            bool printed = true;
+            for (const char* path: paths)
+            {
+                printed = printFileInfo(path, options) && printed;
+            }
+            return printed ? 0 : 1;
+        }
+
+        if (split)
+        {
+            if (paths.size() != 2)
+            {
+                std::cout << "Wrong argument count" << std::endl;
+                printHelp(argv[0]);
+                return 0;
+            }
+            return splitFile(paths[0], paths[1], options) ? 0 : 1;
+        }
+
+        if (concat)
+        {
+            if (paths.empty() || !outputPath)
+            {
+                std::cout << "No enough arguments" << std::endl;
+                printHelp(argv[0]);
+                return 0;
+            }
+            return concatenateFiles(paths, outputPath, threadCount, options) ? 0 : 1;
+        }
+
+        if (exportLibrary)
+        {
+            if (paths.size() != 1)
+            {
+                std::cout << "Wrong argument count" << std::endl;
+                printHelp(argv[0]);
+                return 0;
+            }
+
+            std::vector<std::string> files;
+            if (!collectWaveFiles(paths[0], threadCount, files))
+            {
+                return 1;
+            }
+
+            std::ofstream outputFile;
+            if (outputPath)
+            {
+                outputFile.open(outputPath, std::ios_base::out | std::ios_base::binary);
+                if (!outputFile.is_open())
+                {
+                    std::cerr << "Can't open the specified file \"" << outputPath << "\"" << std::endl;
+                    return 1;
+                }
+            }
+
+            ExportFormat format = csv ? ExportFormat::Csv : ExportFormat::JsonLines;
+            return exportMetadata(files, format, threadCount, outputPath ? outputFile : std::cout) ? 0 : 1;
+        }
+
+        if (manifestPath && inPlace)
+        {
+            std::cout << "--in-place doesn't apply to --batch, a manifest line with only a path patches it in place" << std::endl;
+            printHelp(argv[0]);
+            return 0;
+        }
+
+        size_t expectedPaths = manifestPath ? 0 : (inPlace ? 1 : 2);
+        if (paths.size() != expectedPaths)
         {
             std::cout << "Wrong argument count" << std::endl;
             printHelp(argv[0]);
             return 0;
         }
 
-        bool traceInfo = false;
-        if (argc == 4)
+        std::vector<Marker> markers;
+        if (markersPath)
         {
-            if (strcmp(argv[3], "-t") != 0)
+            if (!readMarkersFile(markersPath, markers))
             {
-                std::cout << "Unknown parameter passed \"" << argv[3] << "\"" << std::endl;
-                return 0;
+                return 1;
+            }
+            options.markers = &markers;
+        }
+
+        std::vector<EditOperation> edits;
+        if (editScriptPath)
+        {
+            if (!readEditScript(editScriptPath, edits))
+            {
+                return 1;
+            }
+            options.edits = &edits;
+        }
+
+        if (autoMarkers)
+        {
+            options.autoMarkers = &autoMarkerSettings;
+        }
+
+        if (manifestPath || batchDir)
+        {
+            std::vector<BatchJob> jobs;
+            bool collected = manifestPath ? readBatchManifest(manifestPath, jobs)
+                                          : collectBatchDirectory(paths[0], inPlace ? nullptr : paths[1], threadCount, jobs);
+            if (!collected)
+            {
+                return 1;
             }
-            traceInfo = true;
+            bool patched = asyncIo ? runBatchAsync(std::move(jobs), threadCount, options)
+                                   : runBatch(std::move(jobs), threadCount, options);
+            return patched ? 0 : 1;
         }
 
-        patchFile(argv[1], argv[2], traceInfo);
+        bool streaming = !inPlace && (strcmp(paths[0], "-") == 0 || strcmp(paths[1], "-") == 0);
+        bool patched = inPlace ? patchFileInPlace(paths[0], options)
+                               : streaming ? patchStream(paths[0], paths[1], options)
+                                           : patchFile(paths[0], paths[1], options);
 
-        return 0;
+        return patched ? 0 : 1;
     }
 
     std::cout << "No enough arguments" << std::endl;
@@ -0,0 +1,52 @@
+#include "mappedfile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+std::shared_ptr<MappedFile> MappedFile::open(const char *fileName)
+{
+    int fd = ::open(fileName, O_RDONLY);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    // Chunks are parsed front to back, the pages behind can be dropped early under memory pressure
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    return std::shared_ptr<MappedFile>(new MappedFile((const uint8_t*)data, st.st_size));
+}
+
+MappedFile::~MappedFile()
+{
+    munmap((void*)m_data, m_size);
+}
+
+void MappedFile::adviseWillNeed(uint64_t offset, uint64_t size) const
+{
+    static const uint64_t pageSize = sysconf(_SC_PAGESIZE);
+
+    if (offset >= m_size || size == 0)
+    {
+        return;
+    }
+
+    uint64_t start = offset / pageSize * pageSize;
+    uint64_t end = std::min<uint64_t>(offset + size, m_size);
+    madvise((void*)(m_data + start), end - start, MADV_WILLNEED);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <memory>
+#include <inttypes.h>
+#include <cstddef>
+
+// A read only mapping of a whole file. Chunks that refer to bytes in it keep a reference,
+// so the mapping lives as long as any of them does
+class MappedFile
+{
+public:
+    static std::shared_ptr<MappedFile> open(const char* fileName);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    // Asks the kernel to start reading a range that is going to be decoded
+    void adviseWillNeed(uint64_t offset, uint64_t size) const;
+
+private:
+    MappedFile(const uint8_t* data, size_t size): m_data(data), m_size(size) {}
+
+    const uint8_t* m_data;
+    size_t m_size;
+};
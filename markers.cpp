@@ -0,0 +1,114 @@
+#include "markers.h"
+#include "mappedfile.h"
+
+#include <iostream>
+#include <cstring>
+#include <sys/stat.h>
+
+namespace
+{
+
+bool isSeparator(char c)
+{
+    return c == '\t' || c == ' ' || c == ',' || c == ';';
+}
+
+// Parses [begin, end) of a single line without its line ending
+bool parseMarkerLine(const char* begin, const char* end, Marker& marker)
+{
+    const char* p = begin;
+    uint64_t offset = 0;
+
+    // Max value for a 32 bit int is 4,294,967,295, i.e. 10 digits
+    while (p < end && *p >= '0' && *p <= '9' && p - begin <= 10)
+    {
+        offset = offset * 10 + (*p - '0');
+        p++;
+    }
+
+    if (p == begin || p - begin > 10 || offset > UINT32_MAX)
+    {
+        return false;
+    }
+
+    if (p < end && !isSeparator(*p))
+    {
+        return false;
+    }
+    while (p < end && isSeparator(*p))
+    {
+        p++;
+    }
+
+    marker.frameOffset = offset;
+    marker.label.assign(p, end - p);
+    return true;
+}
+
+}
+
+bool readMarkersFile(const char *markersPath, std::vector<Marker> &markers)
+{
+    auto file = MappedFile::open(markersPath);
+    if (!file)
+    {
+        // Empty files can't be mapped, they are just a list without markers
+        struct stat st;
+        if (stat(markersPath, &st) == 0 && S_ISREG(st.st_mode) && st.st_size == 0)
+        {
+            return true;
+        }
+        std::cerr << "Can't read the markers file \"" << markersPath << "\"" << std::endl;
+        return false;
+    }
+
+    const char* p = (const char*)file->data();
+    const char* fileEnd = p + file->size();
+    uint64_t lineNumber = 0;
+    size_t firstMarker = markers.size();
+    bool skippedLines = false;
+
+    while (p < fileEnd)
+    {
+        lineNumber++;
+
+        // "\n", "\r\n" and a lone "\r" all end a line
+        const char* lineEnd = p;
+        while (lineEnd < fileEnd && *lineEnd != '\n' && *lineEnd != '\r')
+        {
+            lineEnd++;
+        }
+
+        const char* next = lineEnd;
+        if (next < fileEnd && *next == '\r')
+        {
+            next++;
+        }
+        if (next < fileEnd && *next == '\n')
+        {
+            next++;
+        }
+
+        if (lineEnd != p)
+        {
+            Marker marker;
+            if (parseMarkerLine(p, lineEnd, marker))
+            {
+                markers.push_back(std::move(marker));
+            }
+            else
+            {
+                std::cerr << "Line " << lineNumber << " of the markers file doesn't start with a valid frame offset, skipping it" << std::endl;
+                skippedLines = true;
+            }
+        }
+        p = next;
+    }
+
+    if (markers.size() == firstMarker && skippedLines)
+    {
+        std::cerr << "Did not find any markers in \"" << markersPath << "\"" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <inttypes.h>
+
+struct Marker {
+    uint32_t frameOffset;
+    std::string label;  // no labl sub-chunk is written for an empty label
+};
+
+enum class MarkerMerging {
+    MergeWithExisting,  // existing points are kept, a marker at the offset of one of them relabels it
+    ReplaceExisting     // all the cue points and labels of the file are dropped first
+};
+
+// One marker per line: the frame offset, then optionally a tab, space, comma or semicolon and the label
+// up to the end of the line. Lines may end with "\n", "\r\n" or "\r", empty lines are skipped.
+// Malformed lines are reported and skipped, false is returned when none of the lines was a marker.
+// An empty file is a valid list without markers
+bool readMarkersFile(const char* markersPath, std::vector<Marker>& markers);
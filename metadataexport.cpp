@@ -0,0 +1,305 @@
+#include "metadataexport.h"
+#include "iowave.h"
+#include "workstealingpool.h"
+
+#include <sstream>
+#include <atomic>
+
+namespace
+{
+    // How many records may wait in memory for the ones before them to be written
+    const size_t exportWindowSize = 4096;
+
+    std::string chunkId(const ChunkData* data)
+    {
+        return data->getId().toString();
+    }
+
+    // Length of the UTF-8 sequence that starts at str[i], 0 if the bytes there aren't one
+    size_t utf8SequenceLength(std::string_view str, size_t i)
+    {
+        unsigned char c = str[i];
+        size_t length = 0;
+        if (c >= 0xC2 && c < 0xE0) {
+            length = 2;
+        } else if (c >= 0xE0 && c < 0xF0) {
+            length = 3;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            length = 4;
+        }
+        if (length == 0 || i + length > str.size())
+        {
+            return 0;
+        }
+
+        // No overlong forms, no surrogates, nothing above U+10FFFF
+        unsigned char next = str[i + 1];
+        if ((c == 0xE0 && next < 0xA0) || (c == 0xED && next >= 0xA0) || (c == 0xF0 && next < 0x90) || (c == 0xF4 && next >= 0x90))
+        {
+            return 0;
+        }
+
+        for (size_t k = 1; k < length; k++)
+        {
+            if ((str[i + k] & 0xC0) != 0x80)
+            {
+                return 0;
+            }
+        }
+        return length;
+    }
+
+    // Bytes that aren't UTF-8 are taken for Latin-1, which RIFF texts often are, and escaped
+    void writeJsonString(std::ostream& os, std::string_view str)
+    {
+        static const char hexDigits[] = "0123456789abcdef";
+
+        os << '"';
+        for (size_t i = 0; i < str.size(); i++)
+        {
+            unsigned char c = str[i];
+            switch (c)
+            {
+            case '"':  os << "\\\""; break;
+            case '\\': os << "\\\\"; break;
+            case '\n': os << "\\n"; break;
+            case '\r': os << "\\r"; break;
+            case '\t': os << "\\t"; break;
+            default:
+                if (c >= 0x80) {
+                    size_t length = utf8SequenceLength(str, i);
+                    if (length > 0) {
+                        os << str.substr(i, length);
+                        i += length - 1;
+                    } else {
+                        os << "\\u00" << hexDigits[c >> 4] << hexDigits[c & 0xF];
+                    }
+                } else if (c < 0x20) {
+                    os << "\\u00" << hexDigits[c >> 4] << hexDigits[c & 0xF];
+                } else {
+                    os << c;
+                }
+            }
+        }
+        os << '"';
+    }
+
+    void writeCsvField(std::ostream& os, std::string_view str)
+    {
+        if (str.find_first_of(",\"\r\n") == std::string_view::npos)
+        {
+            os << str;
+            return;
+        }
+
+        os << '"';
+        for (char c: str)
+        {
+            if (c == '"') {
+                os << '"';
+            }
+            os << c;
+        }
+        os << '"';
+    }
+
+    // The labels of a CSV record are joined with '|', a '|' or backslash in a label gets a backslash in front
+    void writeListItem(std::ostream& os, std::string_view str)
+    {
+        for (char c: str)
+        {
+            if (c == '|' || c == '\\') {
+                os << '\\';
+            }
+            os << c;
+        }
+    }
+
+    uint64_t frameCount(const IOWave& wave)
+    {
+        const FormatChunkData* format = wave.getFormat();
+        const ChunkData* data = wave.findChunk("data"_cc);
+
+        if (!format || !data || format->getBlockAlign() == 0)
+        {
+            return 0;
+        }
+        return data->getDataSize() / format->getBlockAlign();
+    }
+
+    double duration(const IOWave& wave)
+    {
+        const FormatChunkData* format = wave.getFormat();
+        return (format && format->getSampleRate() > 0) ? (double)frameCount(wave) / format->getSampleRate() : 0.0;
+    }
+
+    std::string jsonRecord(const std::string& path, const IOWave* wave)
+    {
+        std::ostringstream os;
+
+        os << "{\"path\":";
+        writeJsonString(os, path);
+
+        if (!wave)
+        {
+            os << ",\"error\":\"can't read the file\"}";
+            return os.str();
+        }
+
+        if (const FormatChunkData* format = wave->getFormat())
+        {
+            os << ",\"format\":{\"compressionCode\":" << format->getCompressionCode()
+               << ",\"channels\":" << format->getNumberOfChannels()
+               << ",\"sampleRate\":" << format->getSampleRate()
+               << ",\"bitsPerSample\":" << format->getSignificantBitsPerSample()
+               << ",\"blockAlign\":" << format->getBlockAlign()
+               << ",\"bytesPerSecond\":" << format->getAverageBytesPerSecond() << "}";
+        }
+        os << ",\"frames\":" << frameCount(*wave) << ",\"duration\":" << duration(*wave);
+
+        os << ",\"chunks\":[";
+        bool first = true;
+        for (const ChunkObject& obj: wave->getChunks())
+        {
+            os << (first ? "" : ",") << "{\"id\":";
+            writeJsonString(os, chunkId(obj.data.get()));
+            os << ",\"offset\":" << obj.sourceOffset << ",\"size\":" << obj.data->getDataSize() << "}";
+            first = false;
+        }
+        os << "]";
+
+        os << ",\"cuePoints\":[";
+        if (const CueChunkData* cue = wave->getCuePoints())
+        {
+            std::unordered_map<uint32_t, std::string_view> labels;
+            if (const ListChunkData* list = wave->getLabels())
+            {
+                labels = list->getLabelsByCuePointId();
+            }
+
+            first = true;
+            for (const CuePointData& p: cue->getPoints())
+            {
+                os << (first ? "" : ",") << "{\"id\":" << p.cuePointID << ",\"frame\":" << p.frameOffset;
+
+                auto it = labels.find(p.cuePointID);
+                if (it != labels.end())
+                {
+                    os << ",\"label\":";
+                    writeJsonString(os, it->second);
+                }
+                os << "}";
+                first = false;
+            }
+        }
+        os << "]}";
+
+        return os.str();
+    }
+
+    std::string csvRecord(const std::string& path, const IOWave* wave)
+    {
+        std::ostringstream os;
+
+        writeCsvField(os, path);
+
+        if (!wave)
+        {
+            os << ",,,,,,,,,,,can't read the file";
+            return os.str();
+        }
+
+        const FormatChunkData* format = wave->getFormat();
+        if (format)
+        {
+            os << "," << format->getCompressionCode() << "," << format->getNumberOfChannels()
+               << "," << format->getSampleRate() << "," << format->getSignificantBitsPerSample()
+               << "," << format->getBlockAlign();
+        }
+        else
+        {
+            os << ",,,,,";
+        }
+        os << "," << frameCount(*wave) << "," << duration(*wave) << ",";
+
+        std::ostringstream chunks;
+        for (const ChunkObject& obj: wave->getChunks())
+        {
+            chunks << (chunks.tellp() > 0 ? ";" : "") << chunkId(obj.data.get()) << ":" << obj.sourceOffset << ":" << obj.data->getDataSize();
+        }
+        writeCsvField(os, chunks.str());
+
+        std::ostringstream points, texts;
+        if (const CueChunkData* cue = wave->getCuePoints())
+        {
+            std::unordered_map<uint32_t, std::string_view> labels;
+            if (const ListChunkData* list = wave->getLabels())
+            {
+                labels = list->getLabelsByCuePointId();
+            }
+
+            bool first = true;
+            for (const CuePointData& p: cue->getPoints())
+            {
+                points << (first ? "" : ";") << p.cuePointID << "@" << p.frameOffset;
+
+                auto it = labels.find(p.cuePointID);
+                texts << (first ? "" : "|");
+                if (it != labels.end())
+                {
+                    writeListItem(texts, it->second);
+                }
+                first = false;
+            }
+        }
+        os << ",";
+        writeCsvField(os, points.str());
+        os << ",";
+        writeCsvField(os, texts.str());
+        os << ",";
+
+        return os.str();
+    }
+}
+
+bool exportMetadata(const std::vector<std::string> &files, ExportFormat format, unsigned threadCount, std::ostream &os)
+{
+    if (format == ExportFormat::Csv)
+    {
+        os << "path,compression_code,channels,sample_rate,bits_per_sample,block_align,frames,duration,chunks,cue_points,labels,error\n";
+    }
+
+    std::atomic<size_t> failedCount{0};
+    std::vector<std::string> records;
+    WorkStealingPool pool(threadCount);
+
+    for (size_t windowStart = 0; windowStart < files.size(); windowStart += exportWindowSize)
+    {
+        size_t windowEnd = std::min(files.size(), windowStart + exportWindowSize);
+        records.assign(windowEnd - windowStart, std::string());
+
+        for (size_t i = windowStart; i < windowEnd; i++)
+        {
+            pool.submit([&, i] {
+                IOWave wave;
+                bool loaded = wave.load(files[i].c_str(), true);
+                if (!loaded) {
+                    failedCount++;
+                }
+
+                const IOWave* result = loaded ? &wave : nullptr;
+                records[i - windowStart] = (format == ExportFormat::Csv) ? csvRecord(files[i], result)
+                                                                          : jsonRecord(files[i], result);
+            });
+        }
+        pool.wait();
+
+        for (const std::string& record: records)
+        {
+            os << record << '\n';
+        }
+    }
+    os.flush();
+
+    return failedCount == 0 && !os.fail();
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+enum class ExportFormat {
+    JsonLines,
+    Csv
+};
+
+// Writes one record per file with the format, duration, chunk layout, cue points and labels.
+// Only the chunk headers and metadata chunks are read. Files are processed on threadCount workers
+// in windows of a fixed size, so memory use is bounded, and written in the order of the list
+// CSV has the cue points as a ';' separated list and the labels as a '|' separated one, in which
+// '|' and '\' are escaped with a '\'
+bool exportMetadata(const std::vector<std::string>& files, ExportFormat format, unsigned threadCount, std::ostream& os);
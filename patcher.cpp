@@ -0,0 +1,138 @@
+#include "patcher.h"
+#include "undojournal.h"
+
+#include <iostream>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+std::string fileNameFromPath(const std::string& path)
+{
+    size_t slashIndex = path.find_last_of("/\\");
+    size_t dotIndex = path.find_last_of('.');
+    size_t index1 = (slashIndex == std::string::npos) ? 0 : slashIndex + 1;
+    size_t index2 = (dotIndex == std::string::npos) ? path.size() : dotIndex;
+
+    return path.substr(index1, index2 - index1);
+}
+
+bool applyPatchOptions(IOWave& ioObj, const char* path, const PatchOptions& options)
+{
+    if (!options.markers && !options.edits && !options.autoMarkers)
+    {
+        ioObj.clearPointsAndLabels();
+        auto fileName = fileNameFromPath(path);
+        ioObj.addLabel(fileName.c_str(), 0);
+        return true;
+    }
+
+    if (options.markers)
+    {
+        ioObj.addMarkers(*options.markers, options.markerMerging);
+    }
+    else if (options.autoMarkers && options.markerMerging == MarkerMerging::ReplaceExisting)
+    {
+        ioObj.clearPointsAndLabels();
+    }
+    return !options.edits || ioObj.applyEdits(*options.edits);
+}
+
+bool patchFile(const char* sourcePath, const char* targetPath, const PatchOptions& options)
+{
+    IOWave ioObj(options.traceInfo, options.inputBackend);
+
+    if (ioObj.load(sourcePath) && applyPatchOptions(ioObj, sourcePath, options))
+    {
+        if (options.autoMarkers)
+        {
+            AutoMarkerScanner scanner;
+            return scanner.init(ioObj, *options.autoMarkers)
+                && ioObj.saveWhileScanning(targetPath,
+                                           [&](const uint8_t* data, size_t size) { scanner.scan(data, size); },
+                                           [&](IOWave& wave) { scanner.addMarkers(wave); });
+        }
+        return ioObj.save(targetPath);
+    }
+    return false;
+}
+
+bool patchFileInPlace(const char* path, const PatchOptions& options)
+{
+    if (UndoJournal::exists(path))
+    {
+        std::cerr << "Found an unfinished in-place patch of \"" << path << "\", rolling it back" << std::endl;
+        if (!UndoJournal::rollback(path))
+        {
+            return false;
+        }
+    }
+
+    IOWave ioObj(options.traceInfo, options.inputBackend);
+
+    if (ioObj.load(path) && applyPatchOptions(ioObj, path, options)
+        && (!options.autoMarkers || addAutoMarkers(ioObj, path, *options.autoMarkers)))
+    {
+        return ioObj.saveInPlace();
+    }
+    return false;
+}
+
+bool patchStream(const char* sourcePath, const char* targetPath, const PatchOptions& options)
+{
+    if (options.autoMarkers)
+    {
+        std::cerr << "Markers can't be found in a stream, its metadata is written before the audio data is seen" << std::endl;
+        return false;
+    }
+
+    bool fromStdin = strcmp(sourcePath, "-") == 0;
+    bool toStdout = strcmp(targetPath, "-") == 0;
+
+    int inFd = fromStdin ? STDIN_FILENO : open(sourcePath, O_RDONLY);
+    if (inFd < 0)
+    {
+        std::cerr << "Can't open the specified file \"" << sourcePath << "\"" << std::endl;
+        return false;
+    }
+
+    int outFd = toStdout ? STDOUT_FILENO : open(targetPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (outFd < 0)
+    {
+        std::cerr << "Can't open the specified file \"" << targetPath << "\"" << std::endl;
+        if (!fromStdin) {
+            close(inFd);
+        }
+        return false;
+    }
+
+    // The trace would end up in the middle of the output
+    IOWave ioObj(options.traceInfo && !toStdout);
+
+    // Only replacing them works without the cue and LIST chunks that come after the audio data
+    bool dropLateMetadata = !options.edits && (!options.markers || options.markerMerging == MarkerMerging::ReplaceExisting);
+
+    bool patched = ioObj.loadStreamHead(inFd)
+                && applyPatchOptions(ioObj, fromStdin ? "stdin" : sourcePath, options)
+                && ioObj.saveStream(inFd, outFd, dropLateMetadata);
+
+    if (!fromStdin) {
+        close(inFd);
+    }
+    if (!toStdout) {
+        close(outFd);
+    }
+    return patched;
+}
+
+bool printFileInfo(const char* path, const PatchOptions& options)
+{
+    IOWave ioObj(options.traceInfo, options.inputBackend);
+
+    if (ioObj.load(path, true))
+    {
+        ioObj.printInfo(std::cout);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include "iowave.h"
+#include "editscript.h"
+#include "automarkers.h"
+
+struct PatchOptions {
+    bool traceInfo{false};
+    InputBackend inputBackend{InputBackend::Stream};
+
+    // When set, these markers are applied instead of the single label named after the file
+    const std::vector<Marker>* markers{nullptr};
+    MarkerMerging markerMerging{MarkerMerging::ReplaceExisting};
+
+    // Applied after the markers, also instead of the single label when set
+    const std::vector<EditOperation>* edits{nullptr};
+
+    // Cue points found in the audio data, added after the markers and the edits while the data is copied.
+    // Instead of the single label as well, and they replace the existing cue points unless merging
+    const AutoMarkerSettings* autoMarkers{nullptr};
+};
+
+std::string fileNameFromPath(const std::string& path);
+
+// Replaces the cue points and labels of the file with a single label at offset 0 named after the file,
+// or applies the markers and the edits of the options. The automatic markers are left to the caller
+bool applyPatchOptions(IOWave& ioObj, const char* path, const PatchOptions& options);
+
+// Load, applyPatchOptions and save in one go
+bool patchFile(const char* sourcePath, const char* targetPath, const PatchOptions& options);
+bool patchFileInPlace(const char* path, const PatchOptions& options);
+
+// Like patchFile in a single pass for pipelines, "-" stands for stdin or stdout. The chunks after the audio data
+// are passed on as they arrive, so the markers and edits only see the cue and LIST chunks that come before it
+bool patchStream(const char* sourcePath, const char* targetPath, const PatchOptions& options);
+
+// Reads only the chunk headers and the metadata chunks of the file and prints them
+bool printFileInfo(const char* path, const PatchOptions& options);
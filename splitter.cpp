@@ -0,0 +1,240 @@
+#include "splitter.h"
+#include "patcher.h"
+#include "chunkcopy.h"
+#include "fileio.h"
+#include "bytewriter.h"
+
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <unordered_set>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+
+// Slices that start at the same position inside a filesystem block as in the source can be reflinked
+constexpr uint64_t reflinkAlignment = 4096;
+
+struct Region {
+    uint32_t cuePointId;
+    uint64_t startFrame;
+    uint64_t endFrame;
+};
+
+// A label as a file name: no directories, no control characters
+std::string clipName(std::string_view label, const std::string& sourceName, uint32_t cuePointId)
+{
+    std::string name(label);
+    for (char& c: name)
+    {
+        if (c == '/' || c == '\\' || (unsigned char)c < 0x20)
+        {
+            c = '_';
+        }
+    }
+
+    if (name.empty() || name == "." || name == "..")
+    {
+        name = sourceName + "_" + std::to_string(cuePointId);
+    }
+    return name;
+}
+
+bool writeClip(const std::string& targetPath, const char* sourcePath, const ChunkObject& format,
+               const ChunkLocation& slice, uint64_t frameCount, bool traceInfo)
+{
+    std::vector<uint8_t> head;
+    ByteWriter writer(head);
+
+    uint64_t dataStoredSize = sizeof(ChunkHeader) + slice.size + slice.size % 2;
+    uint64_t headSize = sizeof(WaveHeader) + format.getDataSize() + sizeof(ChunkHeader);
+    bool rf64 = sizeof(WaveHeader::riffType) + format.getDataSize() + dataStoredSize >= oversizedChunkSize;
+
+    ChunkObject ds64(makeChunk<DataSize64ChunkData>(std::pmr::get_default_resource()));
+    if (rf64)
+    {
+        headSize += ds64.getDataSize();
+    }
+
+    // JUNK in front of the data chunk puts the slice at its offset inside a block in the source
+    uint64_t junkSize = 0;
+    if (slice.size >= reflinkAlignment)
+    {
+        junkSize = (slice.startOffset % reflinkAlignment + reflinkAlignment - headSize % reflinkAlignment) % reflinkAlignment;
+        if (junkSize > 0 && junkSize < sizeof(ChunkHeader))
+        {
+            junkSize += reflinkAlignment;
+        }
+    }
+
+    uint64_t riffSize = sizeof(WaveHeader::riffType) + format.getDataSize() + junkSize + dataStoredSize
+                      + (rf64 ? ds64.getDataSize() : 0);
+
+    WaveHeader header;
+    memcpy(header.chunkID, rf64 ? "RF64" : "RIFF", sizeof(header.chunkID));
+    header.dataSize = rf64 ? oversizedChunkSize : riffSize;
+    writer.writeBytes(&header.chunkID[0], sizeof(header));
+
+    if (rf64)
+    {
+        DataSize64ChunkData* sizes = static_cast<DataSize64ChunkData*>(ds64.data.get());
+        sizes->setRiffSize(riffSize);
+        sizes->setDataChunkSize(slice.size);
+        sizes->setSampleCount(frameCount);
+        writer << ds64;
+    }
+
+    writer << format;
+
+    if (junkSize > 0)
+    {
+        writer << ChunkHeader("JUNK"_cc, junkSize - sizeof(ChunkHeader));
+        writer.writeZeros(junkSize - sizeof(ChunkHeader));
+    }
+    writer << ChunkHeader("data"_cc, rf64 ? oversizedChunkSize : slice.size);
+
+    // A clip never replaces a file that is already there, it may be one of an earlier split
+    int fd = open(targetPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+    {
+        if (errno == EEXIST)
+        {
+            std::cerr << "\"" << targetPath << "\" already exists" << std::endl;
+        }
+        else
+        {
+            std::cerr << "Can't open the specified file \"" << targetPath << "\"" << std::endl;
+        }
+        return false;
+    }
+
+    // Sizing the file up front also writes the padding byte of an odd slice
+    bool written = ftruncate(fd, head.size() + slice.size + slice.size % 2) == 0
+                && writeAll(fd, head.data(), head.size(), 0);
+    close(fd);
+
+    if (!written)
+    {
+        std::cerr << "Error writing the file \"" << targetPath << "\"" << std::endl;
+        return false;
+    }
+
+    ChunkCopier copier(sourcePath, targetPath.c_str());
+    CopyStats stats = copier.isOpen() ? copier.copy(slice, head.size()) : CopyStats();
+
+    if (traceInfo)
+    {
+        std::cout << "Wrote \"" << targetPath << "\", " << frameCount << " frames: " << stats << std::endl;
+    }
+
+    if (!stats.succeeded)
+    {
+        std::cerr << "Can't copy the audio data to \"" << targetPath << "\"" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}
+
+bool splitFile(const char* sourcePath, const char* targetDir, const PatchOptions& options)
+{
+    IOWave ioObj(options.traceInfo, options.inputBackend);
+
+    if (!ioObj.load(sourcePath, true))
+    {
+        return false;
+    }
+
+    const ChunkTable& chunks = ioObj.getChunks();
+    size_t formatIndex = chunks.find("fmt "_cc);
+    size_t dataIndex = chunks.find("data"_cc);
+    const FormatChunkData* format = ioObj.getFormat();
+
+    if (!format || format->getBlockAlign() == 0 || dataIndex == ChunkTable::npos)
+    {
+        std::cerr << "\"" << sourcePath << "\" has no audio data in a known format" << std::endl;
+        return false;
+    }
+
+    const ChunkLocation* data = chunks[dataIndex].data->getSourceLocation();
+    uint64_t blockAlign = format->getBlockAlign();
+    uint64_t frameCount = data->size / blockAlign;
+
+    const CueChunkData* cue = ioObj.getCuePoints();
+    if (!cue || cue->getPoints().empty())
+    {
+        std::cerr << "\"" << sourcePath << "\" has no cue points to split at" << std::endl;
+        return false;
+    }
+
+    // Points at the same offset start one region, the one with the lowest ID names it
+    std::vector<CuePointData> points(cue->getPoints().begin(), cue->getPoints().end());
+    std::sort(points.begin(), points.end(), [](const CuePointData& a, const CuePointData& b) {
+        return a.frameOffset != b.frameOffset ? a.frameOffset < b.frameOffset : a.cuePointID < b.cuePointID;
+    });
+
+    std::vector<Region> regions;
+    for (size_t i = 0; i < points.size() && points[i].frameOffset < frameCount; i++)
+    {
+        if (!regions.empty() && regions.back().startFrame == points[i].frameOffset)
+        {
+            continue;
+        }
+        if (!regions.empty())
+        {
+            regions.back().endFrame = points[i].frameOffset;
+        }
+        regions.push_back(Region{points[i].cuePointID, points[i].frameOffset, frameCount});
+    }
+
+    std::unordered_map<uint32_t, std::string_view> labels;
+    if (const ListChunkData* list = ioObj.getLabels())
+    {
+        labels = list->getLabelsByCuePointId();
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(targetDir, ec);
+    if (ec)
+    {
+        std::cerr << "Can't create the directory \"" << targetDir << "\"" << std::endl;
+        return false;
+    }
+
+    std::string sourceName = fileNameFromPath(sourcePath);
+    std::unordered_set<std::string> names;
+    size_t written = 0;
+
+    for (const Region& region: regions)
+    {
+        auto label = labels.find(region.cuePointId);
+        std::string name = clipName(label != labels.end() ? label->second : std::string_view(), sourceName, region.cuePointId);
+
+        // Labels aren't unique, a repeated one gets the cue point ID as well, and a counter if that's taken too
+        if (!names.insert(name).second)
+        {
+            std::string base = name + "_" + std::to_string(region.cuePointId);
+            name = base;
+            for (unsigned n = 2; !names.insert(name).second; n++)
+            {
+                name = base + "_" + std::to_string(n);
+            }
+        }
+
+        ChunkLocation slice{data->startOffset + region.startFrame * blockAlign, (region.endFrame - region.startFrame) * blockAlign};
+        std::string targetPath = (std::filesystem::path(targetDir) / (name + ".wav")).string();
+
+        if (writeClip(targetPath, sourcePath, chunks[formatIndex], slice, region.endFrame - region.startFrame, options.traceInfo))
+        {
+            written++;
+        }
+    }
+
+    std::cout << "Split \"" << sourcePath << "\" into " << written << " of " << regions.size() << " files" << std::endl;
+    return written == regions.size();
+}
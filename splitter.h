@@ -0,0 +1,11 @@
+#pragma once
+
+struct PatchOptions;
+
+// Writes one file per region of the audio data between consecutive cue points to targetDir, the last region runs
+// to the end of the data and the audio before the first cue point is left out. A file is named after the label of
+// the cue point it starts at, or after the source file and the cue point ID when there's no label. Existing
+// files are never overwritten, a clip whose file is already there is reported and not written.
+// The files get the fmt chunk and their slice of the audio data, which is copied without being decoded,
+// and reflinked where the filesystem allows it
+bool splitFile(const char* sourcePath, const char* targetDir, const PatchOptions& options);
@@ -0,0 +1,186 @@
+#include "undojournal.h"
+#include "littleendianint.h"
+#include "fileio.h"
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace
+{
+    const char journalMagic[8] = {'W','P','U','N','D','O','0','2'};
+
+    // Followed by the head and the tail of the file
+    struct JournalHeader {
+        char magic[8];
+        LittleEndianInt64 originalSize;
+        LittleEndianInt64 tailOffset;
+        LittleEndianInt64 headSize;
+    };
+
+    // A rename or unlink is only durable once the directory holding the file is synced
+    void syncParentDirectory(const std::string& path)
+    {
+        size_t slashIndex = path.find_last_of('/');
+        std::string dir = (slashIndex == std::string::npos) ? "." : path.substr(0, slashIndex + 1);
+
+        int fd = open(dir.c_str(), O_RDONLY);
+        if (fd >= 0)
+        {
+            fsync(fd);
+            close(fd);
+        }
+    }
+}
+
+std::string UndoJournal::pathFor(const char *fileName)
+{
+    return std::string(fileName) + ".wpundo";
+}
+
+bool UndoJournal::exists(const char *fileName)
+{
+    struct stat st;
+    return stat(pathFor(fileName).c_str(), &st) == 0;
+}
+
+bool UndoJournal::record(const char *fileName, uint64_t tailOffset, uint64_t headSize)
+{
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Can't open the specified file \"" << fileName << "\"" << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    JournalHeader header;
+    std::vector<char> head;
+    std::vector<char> tail;
+
+    bool ok = fstat(fd, &st) == 0 && (uint64_t)st.st_size >= tailOffset && headSize <= tailOffset;
+    if (ok)
+    {
+        memcpy(header.magic, journalMagic, sizeof(header.magic));
+        header.originalSize = st.st_size;
+        header.tailOffset = tailOffset;
+        header.headSize = headSize;
+        head.resize(headSize);
+        tail.resize(st.st_size - tailOffset);
+
+        ok = readAll(fd, head.data(), head.size(), 0)
+          && readAll(fd, tail.data(), tail.size(), tailOffset);
+    }
+    close(fd);
+
+    if (!ok)
+    {
+        std::cerr << "Can't read the file \"" << fileName << "\" to journal it" << std::endl;
+        return false;
+    }
+
+    // Written under a temporary name first, a journal that exists is always complete
+    std::string journalPath = pathFor(fileName);
+    std::string tmpPath = journalPath + ".tmp";
+
+    fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "Can't create the journal \"" << tmpPath << "\"" << std::endl;
+        return false;
+    }
+
+    ok = writeAll(fd, &header, sizeof(header), 0)
+      && writeAll(fd, head.data(), head.size(), sizeof(header))
+      && writeAll(fd, tail.data(), tail.size(), sizeof(header) + head.size())
+      && fsync(fd) == 0;
+    close(fd);
+
+    if (!ok || rename(tmpPath.c_str(), journalPath.c_str()) != 0)
+    {
+        std::cerr << "Can't write the journal \"" << journalPath << "\"" << std::endl;
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    syncParentDirectory(journalPath);
+    return true;
+}
+
+bool UndoJournal::rollback(const char *fileName)
+{
+    std::string journalPath = pathFor(fileName);
+
+    int journalFd = open(journalPath.c_str(), O_RDONLY);
+    if (journalFd < 0)
+    {
+        std::cerr << "Can't open the journal \"" << journalPath << "\"" << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    JournalHeader header;
+    std::vector<char> head;
+    std::vector<char> tail;
+
+    bool ok = fstat(journalFd, &st) == 0
+           && readAll(journalFd, &header, sizeof(header), 0)
+           && memcmp(header.magic, journalMagic, sizeof(journalMagic)) == 0
+           && header.originalSize.getInt() >= header.tailOffset.getInt()
+           && header.headSize.getInt() <= header.tailOffset.getInt()
+           && (uint64_t)st.st_size == sizeof(header) + header.headSize.getInt() + header.originalSize.getInt() - header.tailOffset.getInt();
+    if (ok)
+    {
+        head.resize(header.headSize.getInt());
+        tail.resize(header.originalSize.getInt() - header.tailOffset.getInt());
+        ok = readAll(journalFd, head.data(), head.size(), sizeof(header))
+          && readAll(journalFd, tail.data(), tail.size(), sizeof(header) + head.size());
+    }
+    close(journalFd);
+
+    if (!ok)
+    {
+        std::cerr << "The journal \"" << journalPath << "\" is damaged" << std::endl;
+        return false;
+    }
+
+    int fd = open(fileName, O_WRONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Can't open the specified file \"" << fileName << "\"" << std::endl;
+        return false;
+    }
+
+    ok = writeAll(fd, head.data(), head.size(), 0)
+      && writeAll(fd, tail.data(), tail.size(), header.tailOffset.getInt())
+      && ftruncate(fd, header.originalSize.getInt()) == 0
+      && fsync(fd) == 0;
+    close(fd);
+
+    if (!ok)
+    {
+        std::cerr << "Can't restore the file \"" << fileName << "\" from its journal" << std::endl;
+        return false;
+    }
+
+    return commit(fileName);
+}
+
+bool UndoJournal::commit(const char *fileName)
+{
+    std::string journalPath = pathFor(fileName);
+
+    if (unlink(journalPath.c_str()) != 0)
+    {
+        std::cerr << "Can't remove the journal \"" << journalPath << "\"" << std::endl;
+        return false;
+    }
+
+    syncParentDirectory(journalPath);
+    return true;
+}
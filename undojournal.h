@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <inttypes.h>
+
+#include "littleendianint.h"
+
+// Keeps the bytes an in-place patch is about to overwrite: the head of the file with the RIFF header, and the file
+// tail from the point where it gets truncated. The journal is made durable before the wave file is touched,
+// so when a run is interrupted the original file can always be restored from it.
+class UndoJournal
+{
+public:
+    static std::string pathFor(const char* fileName);
+    static bool exists(const char* fileName);
+
+    // Saves the first headSize bytes and everything from tailOffset to the end of the file. The head goes beyond
+    // the RIFF header for RF64 files, whose ds64 chunk is rewritten in place as well
+    static bool record(const char* fileName, uint64_t tailOffset, uint64_t headSize = sizeof(WaveHeader));
+
+    // Puts the recorded bytes back, cuts the file to its original size and removes the journal
+    static bool rollback(const char* fileName);
+
+    // The patched file is on disk, the journal isn't needed anymore
+    static bool commit(const char* fileName);
+};
@@ -3,236 +3,714 @@
 
 #include <iostream>
 #include <algorithm>
+#include <functional>
+#include <unordered_set>
 
-ChunkHeader::ChunkHeader(const char *_id, uint32_t _dataSize)
-    : dataSize(_dataSize)
+ChunkHeader::ChunkHeader(FourCC _id, uint32_t _dataSize)
+    : id(_id), dataSize(_dataSize)
 {
-    for (int i = 0; i < 4; i++) {
-        id[i] = _id[i];
-    }
 }
 
-std::ofstream &operator<<(std::ofstream &os, const ChunkHeader &data)
+ByteWriter &operator<<(ByteWriter &buffer, const ChunkHeader &data)
+{
+    buffer.write<uint32_t>(data.id.value());
+    buffer.writeBytes(data.dataSize.data, sizeof(data.dataSize));
+    return buffer;
+}
+
+ByteReader &operator>>(ByteReader &buffer, ChunkHeader &data)
 {
-    os.write(data.id, sizeof(data.id));
-    os << data.dataSize;
-    return os;
+    data.id = FourCC(buffer.read<uint32_t>());
+    data.dataSize = buffer.read<uint32_t>();
+    return buffer;
 }
 
 std::ifstream &operator>>(std::ifstream &is, ChunkHeader &data)
 {
-    is.read(data.id, sizeof(data.id));
+    char id[4];
+    is.read(id, sizeof(id));
+    data.id = FourCC::fromBytes(id);
     is >> data.dataSize;
 
     return is;
 }
 
 
-std::ofstream& operator<<(std::ofstream &os, const ChunkObject &obj)
+ByteWriter& operator<<(ByteWriter &buffer, const ChunkObject &obj)
 {
     if (obj.data)
     {
-        os << obj.data->getHeader();
-        obj.data->writeDataToBuffer(os);
+        buffer << obj.data->getHeader();
+        obj.data->writeDataToBuffer(buffer);
 
         if (obj.data->getDataSize() % 2 != 0)
         {
-            os << '\0';
+            buffer.writeZeros(1);
+        }
+    }
+    return buffer;
+}
+
+namespace
+{
+    uint64_t payloadSize(const ChunkHeader& header, const DataSize64ChunkData* sizes)
+    {
+        uint64_t size = header.dataSize.getInt();
+        return (sizes && size == oversizedChunkSize) ? sizes->getChunkSize(header.id) : size;
+    }
+
+    // A recorder that crashed leaves the audio data shorter than its header says, the chunk keeps what's there
+    uint64_t keptPayloadSize(const ChunkHeader& header, uint64_t size, uint64_t available)
+    {
+        if (size <= available)
+        {
+            return size;
         }
+
+        std::cerr << "Input file is truncated, chunk \"" << header.id << "\" keeps the " << available << " bytes that are there" << std::endl;
+        return available;
     }
-    return os;
 }
 
 std::ifstream& operator>>(std::ifstream &is, ChunkObject &obj)
 {
+    return readChunkObject(is, obj, false, std::pmr::get_default_resource());
+}
+
+std::ifstream& readChunkObject(std::ifstream &is, ChunkObject &obj, bool metadataOnly, std::pmr::memory_resource* resource,
+                               const DataSize64ChunkData* sizes)
+{
+    obj.sourceOffset = is.tellg();
+
     ChunkHeader header;
-    is >> header;
+    if (!(is >> header))
+    {
+        return is;
+    }
 
-    ChunkData* data = Factory::createChunkData(header);
-    data->readDataFromBuffer(is, header.dataSize.getInt());
+    obj.id = header.id;
+    uint64_t size = payloadSize(header, sizes);
+    if (Factory::isKeptInFile(header, metadataOnly))
+    {
+        std::streampos payloadStart = is.tellg();
+        is.seekg(0, std::ios_base::end);
+        size = keptPayloadSize(header, size, uint64_t(is.tellg() - payloadStart));
+        is.seekg(payloadStart);
+    }
+    ChunkPtr data = Factory::createFileChunkData(header, obj.sourceOffset + sizeof(ChunkHeader), size, metadataOnly, resource);
 
-    if (header.dataSize.getInt() % 2 != 0)
+    if (data->getSourceLocation())
     {
-        char tmp;
-        is >> tmp;
+        is.seekg(size, std::ios_base::cur);
     }
+    else
+    {
+        std::vector<uint8_t> payload(size);
+        is.read((char*)payload.data(), size);
 
-    obj.data.reset(data);
+        ByteReader buffer(payload.data(), payload.size());
+        data->readDataFromBuffer(buffer);
+    }
+
+    // The padding byte may be missing at the end of the file
+    if (size % 2 != 0)
+    {
+        is.ignore(1);
+    }
+
+    obj.data = std::move(data);
 
     return is;
 }
 
+ByteReader& readChunkObject(ByteReader &file, ChunkObject &obj, bool metadataOnly, std::pmr::memory_resource* resource,
+                            const DataSize64ChunkData* sizes)
+{
+    obj.sourceOffset = file.position();
+
+    ChunkHeader header;
+    file >> header;
+    if (file.failed())
+    {
+        return file;
+    }
+
+    obj.id = header.id;
+    uint64_t size = payloadSize(header, sizes);
+    if (Factory::isKeptInFile(header, metadataOnly))
+    {
+        size = keptPayloadSize(header, size, file.remaining());
+    }
+    ChunkPtr data = Factory::createFileChunkData(header, obj.sourceOffset + sizeof(ChunkHeader), size, metadataOnly, resource);
+
+    if (data->getSourceLocation())
+    {
+        file.skip(size);
+    }
+    else
+    {
+        if (size > file.remaining())
+        {
+            file.skip(size);
+            return file;
+        }
+
+        ByteReader payload = file.subReader(size);
+        data->readDataFromBuffer(payload);
+    }
+
+    // The padding byte may be missing at the end of the file
+    if (size % 2 != 0)
+    {
+        file.skip(std::min<size_t>(1, file.remaining()));
+    }
+
+    obj.data = std::move(data);
+
+    return file;
+}
+
+
+
+
+uint64_t GeneralChunkData::getDataSize() const { return m_owner ? m_mappedSize : m_rawData.size(); }
 
+void GeneralChunkData::readDataFromBuffer(ByteReader &buffer)
+{
+    if (buffer.owner())
+    {
+        m_owner = buffer.owner();
+        m_mappedData = buffer.data();
+        m_mappedSize = buffer.remaining();
+        m_rawData.clear();
+        return;
+    }
 
+    m_owner.reset();
+    m_rawData.assign(buffer.data(), buffer.data() + buffer.remaining());
+}
 
-const char *GeneralChunkData::getId() const { return m_id.c_str(); }
-uint32_t GeneralChunkData::getDataSize() const { return m_rawData.size(); }
+void GeneralChunkData::writeDataToBuffer(ByteWriter &buffer) const
+{
+    if (m_owner) {
+        buffer.writeBytes(m_mappedData, m_mappedSize);
+    } else {
+        buffer.writeBytes(m_rawData.data(), m_rawData.size());
+    }
+}
 
-void GeneralChunkData::readDataFromBuffer(std::ifstream &is, int size)
+ByteReader GeneralChunkData::getPayload() const
 {
-    m_rawData.resize(size);
-    is.read((char*)m_rawData.data(), size);
+    if (m_owner) {
+        return ByteReader(m_mappedData, m_mappedSize, m_owner);
+    }
+    return ByteReader(m_rawData.data(), m_rawData.size());
 }
 
-void GeneralChunkData::writeDataToBuffer(std::ofstream &os) const
+void PassthroughChunkData::readDataFromBuffer(ByteReader &/*buffer*/)
 {
-    os.write((const char*)m_rawData.data(), m_rawData.size());
+    // The location is known from the header, the payload is never read
 }
 
-std::ofstream &operator<<(std::ofstream &os, const CuePointData &data)
+void PassthroughChunkData::writeDataToBuffer(ByteWriter &/*buffer*/) const
 {
-    os << LittleEndianInt32(data.cuePointID)
-       << LittleEndianInt32(data.playOrderPosition);
-    os.write(data.dataChunkID, 4);
-    os << LittleEndianInt32(data.chunkStart)
-       << LittleEndianInt32(data.blockStart)
-       << LittleEndianInt32(data.frameOffset);
+    // The payload isn't in memory, IOWave::save copies it from the source file using getSourceLocation()
+}
 
-    return os;
+ByteWriter &operator<<(ByteWriter &buffer, const CuePointData &data)
+{
+    buffer.write<uint32_t>(data.cuePointID);
+    buffer.write<uint32_t>(data.playOrderPosition);
+    buffer.writeBytes(data.dataChunkID, 4);
+    buffer.write<uint32_t>(data.chunkStart);
+    buffer.write<uint32_t>(data.blockStart);
+    buffer.write<uint32_t>(data.frameOffset);
+
+    return buffer;
 }
 
-std::ifstream &operator>>(std::ifstream &is, CuePointData &data)
+ByteReader &operator>>(ByteReader &buffer, CuePointData &data)
 {
-    LittleEndianInt32 buff;
-    is >> buff; data.cuePointID = buff.getInt();
-    is >> buff; data.playOrderPosition = buff.getInt();
-    is.read(data.dataChunkID, 4);
-    is >> buff; data.chunkStart = buff.getInt();
-    is >> buff; data.blockStart = buff.getInt();
-    is >> buff; data.frameOffset = buff.getInt();
+    data.cuePointID = buffer.read<uint32_t>();
+    data.playOrderPosition = buffer.read<uint32_t>();
+    buffer.readBytes(data.dataChunkID, 4);
+    data.chunkStart = buffer.read<uint32_t>();
+    data.blockStart = buffer.read<uint32_t>();
+    data.frameOffset = buffer.read<uint32_t>();
+
+    return buffer;
+}
 
-    return is;
+void decodeCuePoints(const uint8_t *source, CuePointData *points, size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    if constexpr (isHostLittleEndian())
+    {
+        memcpy(points, source, count * sizeof(CuePointData));
+    }
+    else
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            ByteReader reader(source + i * sizeof(CuePointData), sizeof(CuePointData));
+            reader >> points[i];
+        }
+    }
 }
 
-void CueChunkData::readDataFromBuffer(std::ifstream &is, int /*size*/)
+void encodeCuePoints(const CuePointData *points, uint8_t *target, size_t count)
 {
-    LittleEndianInt32 pointCount;
-    is >> pointCount;
-    m_points.resize(pointCount.getInt());
+    if (count == 0)
+    {
+        return;
+    }
 
-    for (CuePointData& p: m_points)
+    if constexpr (isHostLittleEndian())
     {
-        is >> p;
+        memcpy(target, points, count * sizeof(CuePointData));
+    }
+    else
+    {
+        std::vector<uint8_t> record;
+        record.reserve(sizeof(CuePointData));
+        for (size_t i = 0; i < count; i++)
+        {
+            record.clear();
+            ByteWriter writer(record);
+            writer << points[i];
+            memcpy(target + i * sizeof(CuePointData), record.data(), sizeof(CuePointData));
+        }
     }
 }
 
-void CueChunkData::writeDataToBuffer(std::ofstream &os) const
+void CueChunkData::readDataFromBuffer(ByteReader &buffer)
 {
-    os << LittleEndianInt32(m_points.size());
+    uint32_t pointCount = buffer.read<uint32_t>();
 
-    for (const CuePointData& p: m_points) {
-        os << p;
+    // Don't trust a count that doesn't fit the chunk
+    static const size_t pointSize = sizeof(CuePointData);
+    if (pointCount > buffer.remaining() / pointSize)
+    {
+        std::cerr << "Wrong cue point count" << std::endl;
+        pointCount = buffer.remaining() / pointSize;
     }
+    m_points.resize(pointCount);
+    decodeCuePoints(buffer.take(pointCount * pointSize), m_points.data(), pointCount);
+
+    rebuildIndex();
+}
+
+void CueChunkData::writeDataToBuffer(ByteWriter &buffer) const
+{
+    buffer.write<uint32_t>(m_points.size());
+    encodeCuePoints(m_points.data(), buffer.append(m_points.size() * sizeof(CuePointData)), m_points.size());
 }
 
 uint32_t CueChunkData::addPointIfAbsent(uint32_t frameOffset)
 {
-    auto it = std::find_if(m_points.begin(), m_points.end(), [frameOffset](const CuePointData& p) { return p.frameOffset == frameOffset; });
-    if (it != m_points.end()) {
-        return it->cuePointID;
+    auto it = m_idByFrameOffset.find(frameOffset);
+    if (it != m_idByFrameOffset.end()) {
+        return it->second;
     }
+    return addPoint(frameOffset);
+}
 
+uint32_t CueChunkData::addPoint(uint32_t frameOffset)
+{
     CuePointData p;
-    p.cuePointID = m_points.size() + 1;
+    p.cuePointID = allocateId();
     p.frameOffset = frameOffset;
+
+    m_idByFrameOffset.emplace(frameOffset, p.cuePointID);
+    m_slotById.emplace(p.cuePointID, m_points.size());
     m_points.push_back(p);
 
     return p.cuePointID;
 }
 
+bool CueChunkData::removePoint(uint32_t cuePointId)
+{
+    auto it = m_slotById.find(cuePointId);
+    if (it == m_slotById.end()) {
+        return false;
+    }
+
+    size_t slot = it->second;
+    uint32_t frameOffset = m_points[slot].frameOffset;
+    m_slotById.erase(it);
+    m_points.erase(m_points.begin() + slot);
+
+    // A later point at the same offset becomes the one found by it
+    auto offsetIt = m_idByFrameOffset.find(frameOffset);
+    bool offsetFree = offsetIt != m_idByFrameOffset.end() && offsetIt->second == cuePointId;
+    if (offsetFree) {
+        m_idByFrameOffset.erase(offsetIt);
+    }
+
+    // The points behind the removed one move up a slot, their order stays as it was
+    for (size_t i = slot; i < m_points.size(); i++)
+    {
+        const CuePointData& p = m_points[i];
+        m_slotById[p.cuePointID] = i;
+        if (offsetFree && p.frameOffset == frameOffset)
+        {
+            m_idByFrameOffset.emplace(frameOffset, p.cuePointID);
+            offsetFree = false;
+        }
+    }
+
+    m_freeIds.push_back(cuePointId);
+    std::push_heap(m_freeIds.begin(), m_freeIds.end(), std::greater<uint32_t>());
+
+    return true;
+}
+
+void CueChunkData::clear()
+{
+    m_points.clear();
+    rebuildIndex();
+}
+
+void CueChunkData::reserve(size_t pointCount)
+{
+    m_points.reserve(pointCount);
+    m_idByFrameOffset.reserve(pointCount);
+    m_slotById.reserve(pointCount);
+}
+
+bool CueChunkData::shiftPoints(int64_t frames)
+{
+    // Clamping would pile separate points up on the same frame
+    for (const CuePointData& p: m_points)
+    {
+        int64_t offset = int64_t(p.frameOffset) + frames;
+        if (offset < 0 || offset > UINT32_MAX) {
+            return false;
+        }
+    }
+
+    m_idByFrameOffset.clear();
+
+    for (CuePointData& p: m_points)
+    {
+        p.frameOffset = int64_t(p.frameOffset) + frames;
+        m_idByFrameOffset.emplace(p.frameOffset, p.cuePointID);
+    }
+    return true;
+}
+
+const CuePointData *CueChunkData::findPoint(uint32_t cuePointId) const
+{
+    auto it = m_slotById.find(cuePointId);
+    return it != m_slotById.end() ? &m_points[it->second] : nullptr;
+}
 
-void SubListChunkData::readDataFromBuffer(std::ifstream &is, int size)
+void CueChunkData::rebuildIndex()
 {
-    LittleEndianInt32 cuePointId;
-    is >> cuePointId;
-    m_cuePointId = cuePointId.getInt();
-    m_label.resize(0);
+    m_idByFrameOffset.clear();
+    m_slotById.clear();
+    m_freeIds.clear();
+    m_nextId = 1;
+
+    m_idByFrameOffset.reserve(m_points.size());
+    m_slotById.reserve(m_points.size());
 
-    char buff;
-    is >> buff;
-    while (buff)
+    for (size_t i = 0; i < m_points.size(); i++)
     {
-        m_label += buff;
-        is >> buff;
+        const CuePointData& p = m_points[i];
+        m_idByFrameOffset.emplace(p.frameOffset, p.cuePointID);
+        m_slotById.emplace(p.cuePointID, i);
+        m_nextId = std::max(m_nextId, p.cuePointID + 1);
     }
 }
 
-void SubListChunkData::writeDataToBuffer(std::ofstream &os) const
+uint32_t CueChunkData::allocateId()
 {
-    os << LittleEndianInt32(m_cuePointId) << m_label.c_str() << '\0';
+    while (!m_freeIds.empty())
+    {
+        std::pop_heap(m_freeIds.begin(), m_freeIds.end(), std::greater<uint32_t>());
+        uint32_t id = m_freeIds.back();
+        m_freeIds.pop_back();
+
+        // A duplicate ID from the file may still be taken
+        if (m_slotById.find(id) == m_slotById.end()) {
+            return id;
+        }
+    }
+
+    while (m_slotById.find(m_nextId) != m_slotById.end()) {
+        m_nextId++;
+    }
+    return m_nextId++;
 }
 
-const char *ListChunkData::getId() const { return "LIST"; }
 
-uint32_t ListChunkData::getDataSize() const
+void SubListChunkData::readDataFromBuffer(ByteReader &buffer)
 {
-    uint32_t size = sizeof(m_typeId);
+    m_cuePointId = buffer.read<uint32_t>();
+
+    const char* text = (const char*)buffer.data();
+    const void* terminator = memchr(text, '\0', buffer.remaining());
+    size_t length = terminator ? (const char*)terminator - text : buffer.remaining();
+
+    m_label.assign(text, length);
+}
+
+void SubListChunkData::writeDataToBuffer(ByteWriter &buffer) const
+{
+    buffer.write<uint32_t>(m_cuePointId);
+    buffer.writeBytes(m_label.data(), m_label.size());
+    buffer.writeZeros(1);
+}
+
+
+void ListChunkData::relabel(SubListChunkData *label, std::string_view text)
+{
+    m_dataSize -= ChunkObject::storedSize(label->getDataSize());
+    label->setLabel(text);
+    m_dataSize += ChunkObject::storedSize(label->getDataSize());
+}
+
+std::unordered_map<uint32_t, std::string_view> ListChunkData::getLabelsByCuePointId() const
+{
+    std::unordered_map<uint32_t, std::string_view> labels;
+
     for (const ChunkObject& obj: m_lst)
     {
-        size += obj.getDataSize();
+        if (obj.id == "labl"_cc)
+        {
+            const SubListChunkData* label = static_cast<const SubListChunkData*>(obj.data.get());
+            labels.emplace(label->getCuePointId(), label->getLabel());
+        }
+    }
+    return labels;
+}
+
+void ListChunkData::setLabels(const std::vector<std::pair<uint32_t, const std::string *>> &labels)
+{
+    std::unordered_map<uint32_t, SubListChunkData*> existing;
+    existing.reserve(m_lst.size() + labels.size());
+
+    for (ChunkObject& obj: m_lst)
+    {
+        if (obj.id == "labl"_cc)
+        {
+            SubListChunkData* label = static_cast<SubListChunkData*>(obj.data.get());
+            existing.emplace(label->getCuePointId(), label);
+        }
+    }
+
+    m_lst.reserve(m_lst.size() + labels.size());
+
+    for (const auto& label: labels)
+    {
+        auto it = existing.find(label.first);
+        if (it != existing.end())
+        {
+            relabel(it->second, *label.second);
+            continue;
+        }
+
+        ChunkPtr data = makeChunk<SubListChunkData>(resource(), label.first, *label.second);
+        existing.emplace(label.first, static_cast<SubListChunkData*>(data.get()));
+        addData(std::move(data));
+    }
+}
+
+void ListChunkData::replaceLabels(const std::unordered_map<uint32_t, std::string> &labels)
+{
+    std::unordered_set<uint32_t> kept;
+    kept.reserve(labels.size());
+
+    auto last = std::remove_if(m_lst.begin(), m_lst.end(), [this, &labels, &kept](ChunkObject& obj) {
+        if (obj.id != "labl"_cc) {
+            return false;
+        }
+
+        SubListChunkData* label = static_cast<SubListChunkData*>(obj.data.get());
+        auto it = labels.find(label->getCuePointId());
+        if (it == labels.end() || !kept.insert(it->first).second) {
+            m_dataSize -= obj.getDataSize();
+            return true;
+        }
+
+        relabel(label, it->second);
+        return false;
+    });
+    m_lst.erase(last, m_lst.end());
+
+    std::vector<uint32_t> missing;
+    for (const auto& label: labels)
+    {
+        if (kept.find(label.first) == kept.end())
+        {
+            missing.push_back(label.first);
+        }
+    }
+    std::sort(missing.begin(), missing.end());
+
+    m_lst.reserve(m_lst.size() + missing.size());
+    for (uint32_t cuePointId: missing)
+    {
+        addData(makeChunk<SubListChunkData>(resource(), cuePointId, labels.at(cuePointId)));
     }
-    return size;
 }
 
-void ListChunkData::readDataFromBuffer(std::ifstream &is, int size)
+void ListChunkData::readDataFromBuffer(ByteReader &buffer)
 {
-    is.read(m_typeId, 4);
-    size -= 4;
-    m_lst.resize(0);
+    m_typeId = FourCC(buffer.read<uint32_t>());
+    clear();
 
-    while (size > 0)
+    while (buffer.remaining() >= sizeof(ChunkHeader))
     {
-        m_lst.push_back(ChunkObject());
-        is >> m_lst.back();
-        size -= m_lst.back().getDataSize();
+        ChunkHeader header;
+        buffer >> header;
+        uint32_t size = header.dataSize.getInt();
+
+        // A sub-chunk running past the end keeps what's left of it, with the size it really has
+        if (size > buffer.remaining())
+        {
+            std::cerr << "Wrong size" << std::endl;
+            size = buffer.remaining();
+        }
+
+        ByteReader subBuffer = buffer.subReader(size);
+        ChunkPtr data = Factory::createChunkData(header, resource());
+        data->readDataFromBuffer(subBuffer);
+        addData(std::move(data));
+
+        if (size % 2 != 0)
+        {
+            buffer.skip(std::min<size_t>(1, buffer.remaining()));
+        }
     }
 
-    if (size != 0)
+    if (!buffer.atEnd())
     {
         std::cerr << "Wrong size" << std::endl;
     }
 }
 
-void ListChunkData::writeDataToBuffer(std::ofstream &os) const
+void ListChunkData::writeDataToBuffer(ByteWriter &buffer) const
 {
-    os.write(m_typeId, 4);
+    buffer.write<uint32_t>(m_typeId.value());
     for (const ChunkObject& obj: m_lst)
     {
-        os << obj;
+        buffer << obj;
     }
 }
 
-void FormatChunkData::readDataFromBuffer(std::ifstream &is, int size)
+void FormatChunkData::readDataFromBuffer(ByteReader &buffer)
+{
+    m_compressionCode = buffer.read<uint16_t>();
+    m_numberOfChannels = buffer.read<uint16_t>();
+    m_sampleRate = buffer.read<uint32_t>();
+    m_averageBytesPerSecond = buffer.read<uint32_t>();
+    m_blockAlign = buffer.read<uint16_t>();
+    m_significantBitsPerSample = buffer.read<uint16_t>();
+
+    m_extraFormatData.assign(buffer.data(), buffer.data() + buffer.remaining());
+}
+
+void FormatChunkData::writeDataToBuffer(ByteWriter &buffer) const
 {
-    LittleEndianInt16 buff16;
-    LittleEndianInt32 buff32;
+    buffer.write<uint16_t>(m_compressionCode);
+    buffer.write<uint16_t>(m_numberOfChannels);
+    buffer.write<uint32_t>(m_sampleRate);
+    buffer.write<uint32_t>(m_averageBytesPerSecond);
+    buffer.write<uint16_t>(m_blockAlign);
+    buffer.write<uint16_t>(m_significantBitsPerSample);
+    buffer.writeBytes(m_extraFormatData.data(), m_extraFormatData.size());
+}
 
-    is >> buff16; m_compressionCode = buff16.getInt();
-    is >> buff16; m_numberOfChannels = buff16.getInt();
-    is >> buff32; m_sampleRate = buff32.getInt();
-    is >> buff32; m_averageBytesPerSecond = buff32.getInt();
-    is >> buff16; m_blockAlign = buff16.getInt();
-    is >> buff16; m_significantBitsPerSample = buff16.getInt();
+bool FormatChunkData::isSameFormat(const FormatChunkData &other) const
+{
+    return m_compressionCode == other.m_compressionCode
+        && m_numberOfChannels == other.m_numberOfChannels
+        && m_sampleRate == other.m_sampleRate
+        && m_averageBytesPerSecond == other.m_averageBytesPerSecond
+        && m_blockAlign == other.m_blockAlign
+        && m_significantBitsPerSample == other.m_significantBitsPerSample
+        && m_extraFormatData == other.m_extraFormatData;
+}
+
+uint16_t FormatChunkData::getSampleFormatCode() const
+{
+    // cbSize, valid bits per sample and the channel mask come before the sub format
+    constexpr size_t subFormatOffset = 8;
 
-    size -= 16;
-    if (size > 0)
+    if (m_compressionCode == 0xFFFE && m_extraFormatData.size() >= subFormatOffset + 2)
     {
-        m_extraFormatData.resize(size);
-        is.read((char*)m_extraFormatData.data(), size);
+        return m_extraFormatData[subFormatOffset] | (m_extraFormatData[subFormatOffset + 1] << 8);
     }
+    return m_compressionCode;
 }
 
-void FormatChunkData::writeDataToBuffer(std::ofstream &os) const
+
+void DataSize64ChunkData::readDataFromBuffer(ByteReader &buffer)
+{
+    m_riffSize = buffer.read<uint64_t>();
+    m_dataChunkSize = buffer.read<uint64_t>();
+    m_sampleCount = buffer.read<uint64_t>();
+
+    uint32_t tableLength = buffer.read<uint32_t>();
+    m_table.clear();
+    m_table.reserve(std::min<size_t>(tableLength, buffer.remaining() / sizeof(TableEntry)));
+
+    for (uint32_t i = 0; i < tableLength && buffer.remaining() >= sizeof(TableEntry); i++)
+    {
+        TableEntry entry;
+        entry.id = FourCC(buffer.read<uint32_t>());
+        entry.size = buffer.read<uint64_t>();
+        m_table.push_back(entry);
+    }
+
+    if (buffer.failed())
+    {
+        std::cerr << "Wrong size" << std::endl;
+    }
+}
+
+void DataSize64ChunkData::writeDataToBuffer(ByteWriter &buffer) const
 {
-    os << LittleEndianInt16(m_compressionCode)
-       << LittleEndianInt16(m_numberOfChannels)
-       << LittleEndianInt32(m_sampleRate)
-       << LittleEndianInt32(m_averageBytesPerSecond)
-       << LittleEndianInt16(m_blockAlign)
-       << LittleEndianInt16(m_significantBitsPerSample);
+    buffer.write<uint64_t>(m_riffSize);
+    buffer.write<uint64_t>(m_dataChunkSize);
+    buffer.write<uint64_t>(m_sampleCount);
+    buffer.write<uint32_t>(m_table.size());
 
-    if (!m_extraFormatData.empty())
+    for (const TableEntry& entry: m_table)
+    {
+        buffer.write<uint32_t>(entry.id.value());
+        buffer.writeBytes(entry.size.data, sizeof(entry.size));
+    }
+}
+
+uint64_t DataSize64ChunkData::getChunkSize(FourCC id) const
+{
+    if (id == "data"_cc)
+    {
+        return m_dataChunkSize;
+    }
+
+    for (const TableEntry& entry: m_table)
+    {
+        if (entry.id == id)
+        {
+            return entry.size.getInt();
+        }
+    }
+    return oversizedChunkSize;
+}
+
+void DataSize64ChunkData::setChunkSizes(const std::vector<std::pair<FourCC, uint64_t>> &sizes)
+{
+    m_table.clear();
+    for (const auto& size: sizes)
     {
-        os.write((const char*)m_extraFormatData.data(), m_extraFormatData.size());
+        m_table.push_back(TableEntry{size.first, size.second});
     }
 }
@@ -5,91 +5,215 @@
 #include <array>
 #include <vector>
 #include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_map>
 
 #include "littleendianint.h"
+#include "fourcc.h"
+#include "bytereader.h"
+#include "bytewriter.h"
 
 
 struct ChunkHeader {
-    char id[4];
+    FourCC id;
     LittleEndianInt32 dataSize;
 
     ChunkHeader() = default;
-    ChunkHeader(const char* _id, uint32_t _dataSize);
+    ChunkHeader(FourCC _id, uint32_t _dataSize);
 };
 
-std::ofstream& operator<<(std::ofstream& os, const ChunkHeader& data);
+static_assert(sizeof(ChunkHeader) == 8, "ChunkHeader must have the size of a chunk header in the file");
+
+// Written instead of sizes that don't fit 32 bits, RF64 files have the real ones in their ds64 chunk
+constexpr uint32_t oversizedChunkSize = 0xFFFFFFFF;
+
+ByteWriter& operator<<(ByteWriter& buffer, const ChunkHeader& data);
+ByteReader& operator>>(ByteReader& buffer, ChunkHeader& data);
 std::ifstream& operator>>(std::ifstream& is, ChunkHeader& data);
 
 
+// Position of a chunk payload in the source file, for chunks that are copied over without being loaded
+struct ChunkLocation {
+    uint64_t startOffset{0}; // in bytes
+    uint64_t size{0};        // in bytes
+};
+
+
 class ChunkData
 {
 public:
+    explicit ChunkData(FourCC id): m_id(id) {}
     virtual ~ChunkData() {}
 
-    virtual void readDataFromBuffer(std::ifstream& is, int size) = 0;
-    virtual void writeDataToBuffer(std::ofstream& os) const = 0;
+    // The buffer holds exactly the chunk payload
+    virtual void readDataFromBuffer(ByteReader& buffer) = 0;
+    // Writes the getDataSize() bytes of the payload, chunks kept in the source file write nothing
+    virtual void writeDataToBuffer(ByteWriter& buffer) const = 0;
 
-    virtual const char* getId() const = 0;
-    virtual uint32_t getDataSize() const = 0;
+    FourCC getId() const { return m_id; }
+    virtual uint64_t getDataSize() const = 0;
+
+    // Chunks that keep their payload in the source file return its location here
+    virtual const ChunkLocation* getSourceLocation() const { return nullptr; }
 
     inline ChunkHeader getHeader() const {
-        return ChunkHeader(getId(), getDataSize());
+        uint64_t size = getDataSize();
+        return ChunkHeader(getId(), size < oversizedChunkSize ? uint32_t(size) : oversizedChunkSize);
     }
+
+protected:
+    FourCC m_id;
 };
 
+// Chunks made by makeChunk go back to the memory resource they came from, which is a no-op for the
+// monotonic arena of an IOWave. Chunks made with plain new, e.g. by registered factories, are deleted
+struct ChunkDeleter
+{
+    std::pmr::memory_resource* resource{nullptr};
+    size_t size{0};
+    size_t alignment{0};
+
+    void operator()(ChunkData* data) const
+    {
+        if (!resource) {
+            delete data;
+            return;
+        }
+        data->~ChunkData();
+        resource->deallocate(data, size, alignment);
+    }
+};
+
+using ChunkPtr = std::unique_ptr<ChunkData, ChunkDeleter>;
+
+// Constructs a chunk in resource. Chunk types that take a memory resource as their last constructor
+// argument get it as well, for their tables and texts
+template <typename T, typename... Args>
+ChunkPtr makeChunk(std::pmr::memory_resource* resource, Args&&... args)
+{
+    void* memory = resource->allocate(sizeof(T), alignof(T));
+    T* chunk;
+    if constexpr (std::is_constructible<T, Args..., std::pmr::memory_resource*>::value) {
+        chunk = new (memory) T(std::forward<Args>(args)..., resource);
+    } else {
+        chunk = new (memory) T(std::forward<Args>(args)...);
+    }
+    return ChunkPtr(chunk, ChunkDeleter{resource, sizeof(T), alignof(T)});
+}
+
 struct ChunkObject
 {
     ChunkObject() = default;
     ChunkObject(const ChunkObject&) = delete;
     ChunkObject& operator=(const ChunkObject&) = delete;
 
-    ChunkObject(ChunkObject&& obj): data(obj.data.release()) {}
-    ChunkObject(ChunkData* data): data(data) {}
+    ChunkObject(ChunkObject&& obj) noexcept: id(obj.id), data(std::move(obj.data)), sourceOffset(obj.sourceOffset) {}
+    ChunkObject& operator=(ChunkObject&& obj) noexcept {
+        id = obj.id;
+        data = std::move(obj.data);
+        sourceOffset = obj.sourceOffset;
+        return *this;
+    }
+    ChunkObject(ChunkPtr data): id(data->getId()), data(std::move(data)) {}
 
-    uint32_t getDataSize() const {
-        if (data)  {
-            uint32_t size = sizeof(ChunkHeader) + data->getDataSize();
-            return size + (size % 2);
-        }
-        return 0;
+    uint64_t getDataSize() const {
+        return data ? storedSize(data->getDataSize()) : 0;
+    }
+
+    // Bytes a chunk with a payload of payloadSize takes in the file, with its header and padding
+    static uint64_t storedSize(uint64_t payloadSize) {
+        return sizeof(ChunkHeader) + payloadSize + (payloadSize % 2);
     }
 
-    std::unique_ptr<ChunkData> data;
+    FourCC id;     // same as data->getId(), kept here so scans over the chunks don't touch the payloads
+    ChunkPtr data;
+    int64_t sourceOffset{-1}; // position of the chunk header in the source file, -1 for chunks created in memory
 };
 
-std::ofstream& operator<<(std::ofstream& os, const ChunkObject& obj);
+// Header, payload and padding byte
+ByteWriter& operator<<(ByteWriter& buffer, const ChunkObject& obj);
 std::ifstream& operator>>(std::ifstream& is, ChunkObject& obj);
 
+class DataSize64ChunkData;
+
+// Reads the chunk payload with a single read into a chunk allocated in resource, as raw bytes that are decoded
+// when they're first needed. With metadataOnly the payloads of all the chunks but fmt, cue and LIST are skipped instead of read.
+// In RF64 files sizes gives the real size of the chunks whose header says oversizedChunkSize
+std::ifstream& readChunkObject(std::ifstream& is, ChunkObject& obj, bool metadataOnly, std::pmr::memory_resource* resource,
+                               const DataSize64ChunkData* sizes = nullptr);
+
+// Same for a file that is mapped as a whole, the payloads are views of the mapping
+ByteReader& readChunkObject(ByteReader& file, ChunkObject& obj, bool metadataOnly, std::pmr::memory_resource* resource,
+                            const DataSize64ChunkData* sizes = nullptr);
+
 
 class GeneralChunkData : public ChunkData
 {
 public:
-    GeneralChunkData(const ChunkHeader& header) {
-        m_id.resize(4);
-        for (int i = 0; i < 4; i++) {
-            m_id[i] = header.id[i];
-        }
+    GeneralChunkData(const ChunkHeader& header, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : ChunkData(header.id), m_rawData(resource) {}
+
+    virtual uint64_t getDataSize() const override;
+
+    virtual void readDataFromBuffer(ByteReader& buffer) override;
+    virtual void writeDataToBuffer(ByteWriter& buffer) const override;
+
+    // The payload as it is, for decoding it into a typed chunk later
+    ByteReader getPayload() const;
+
+private:
+    // Either a copy of the payload, or a view of it in a mapped source file that m_owner keeps alive
+    std::pmr::vector<uint8_t> m_rawData;
+    const uint8_t* m_mappedData{nullptr};
+    uint64_t m_mappedSize{0};
+    std::shared_ptr<const void> m_owner;
+};
+
+
+// Records only where the payload is in the source file, IOWave::save streams it to the target.
+// Used for the audio data, so memory use doesn't depend on the file size
+class PassthroughChunkData : public ChunkData
+{
+public:
+    PassthroughChunkData(FourCC id, uint64_t payloadOffset, uint64_t payloadSize): ChunkData(id) {
+        m_location.startOffset = payloadOffset;
+        m_location.size = payloadSize;
     }
 
-    virtual const char* getId() const override;
-    virtual uint32_t getDataSize() const override;
+    virtual uint64_t getDataSize() const override { return m_location.size; }
+    virtual const ChunkLocation* getSourceLocation() const override { return &m_location; }
 
-    virtual void readDataFromBuffer(std::ifstream& is, int size) override;
-    virtual void writeDataToBuffer(std::ofstream& os) const override;
+    virtual void readDataFromBuffer(ByteReader& buffer) override;
+    virtual void writeDataToBuffer(ByteWriter& buffer) const override;
 
 private:
-    std::string m_id;
-    std::vector<uint8_t> m_rawData;
+    ChunkLocation m_location;
 };
 
 
 class FormatChunkData: public ChunkData {
 public:
-    virtual const char* getId() const override { return "fmt "; }
-    virtual uint32_t getDataSize() const override { return m_extraFormatData.size() + 16; }
+    FormatChunkData(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : ChunkData("fmt "_cc), m_extraFormatData(resource) {}
+
+    virtual uint64_t getDataSize() const override { return m_extraFormatData.size() + 16; }
 
-    virtual void readDataFromBuffer(std::ifstream& is, int size) override;
-    virtual void writeDataToBuffer(std::ofstream& os) const override;
+    virtual void readDataFromBuffer(ByteReader& buffer) override;
+    virtual void writeDataToBuffer(ByteWriter& buffer) const override;
+
+    uint16_t getCompressionCode() const { return m_compressionCode; }
+    uint16_t getNumberOfChannels() const { return m_numberOfChannels; }
+    uint32_t getSampleRate() const { return m_sampleRate; }
+    uint32_t getAverageBytesPerSecond() const { return m_averageBytesPerSecond; }
+    uint16_t getBlockAlign() const { return m_blockAlign; }
+    uint16_t getSignificantBitsPerSample() const { return m_significantBitsPerSample; }
+
+    // The same fields and extension, so the audio data of both can go into one data chunk
+    bool isSameFormat(const FormatChunkData& other) const;
+
+    // The compression code, or the one the sub format GUID of WAVE_FORMAT_EXTENSIBLE starts with
+    uint16_t getSampleFormatCode() const;
 private:
     uint16_t m_compressionCode;
     uint16_t m_numberOfChannels;
@@ -97,7 +221,7 @@ private:
     uint32_t m_averageBytesPerSecond;
     uint16_t m_blockAlign;
     uint16_t m_significantBitsPerSample;
-    std::vector<uint8_t> m_extraFormatData;
+    std::pmr::vector<uint8_t> m_extraFormatData;
 };
 
 
@@ -110,39 +234,79 @@ struct CuePointData {
     uint32_t frameOffset{0};
 };
 
-std::ofstream& operator<<(std::ofstream& os, const CuePointData& data);
-std::ifstream& operator>>(std::ifstream& is, CuePointData& data);
+// The fields are laid out exactly like the 24 bytes of a cue point in the file, so on little endian hosts
+// a whole table is decoded and encoded with one copy
+static_assert(sizeof(CuePointData) == 24 && std::is_trivially_copyable<CuePointData>::value, "CuePointData must match the file layout");
+
+ByteWriter& operator<<(ByteWriter& buffer, const CuePointData& data);
+ByteReader& operator>>(ByteReader& buffer, CuePointData& data);
+
+void decodeCuePoints(const uint8_t* source, CuePointData* points, size_t count);
+void encodeCuePoints(const CuePointData* points, uint8_t* target, size_t count);
 
 
 class CueChunkData: public ChunkData
 {
 public:
-    virtual const char* getId() const override { return "cue "; }
-    virtual uint32_t getDataSize() const override { return sizeof(CuePointData) * m_points.size() + 4; }
+    CueChunkData(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : ChunkData("cue "_cc), m_points(resource), m_idByFrameOffset(resource), m_slotById(resource), m_freeIds(resource) {}
 
-    virtual void readDataFromBuffer(std::ifstream& is, int size);
-    virtual void writeDataToBuffer(std::ofstream& os) const;
+    virtual uint64_t getDataSize() const override { return sizeof(CuePointData) * m_points.size() + 4; }
 
+    virtual void readDataFromBuffer(ByteReader& buffer);
+    virtual void writeDataToBuffer(ByteWriter& buffer) const;
+
+    // Returns the ID of the point at frameOffset, adding it first if there's none
     uint32_t addPointIfAbsent(uint32_t frameOffset);
+    // Adds a new point even if there's one at frameOffset already
+    uint32_t addPoint(uint32_t frameOffset);
+
+    // The other points keep their order, the ID of the removed one becomes free for new points
+    bool removePoint(uint32_t cuePointId);
+    void clear();
+    void reserve(size_t pointCount);
+
+    // Moves every point by frames, the IDs stay the same. Nothing is moved and false is returned
+    // if a point would leave the 32 bit range
+    bool shiftPoints(int64_t frames);
+
+    const CuePointData* findPoint(uint32_t cuePointId) const;
+    const std::pmr::vector<CuePointData>& getPoints() const { return m_points; }
 private:
-    std::vector<CuePointData> m_points;
+    void rebuildIndex();
+    uint32_t allocateId();
+
+    std::pmr::vector<CuePointData> m_points;
+
+    // Lookups by offset and by ID without scanning the points, the first point wins on duplicates
+    std::pmr::unordered_map<uint32_t, uint32_t> m_idByFrameOffset;
+    std::pmr::unordered_map<uint32_t, size_t> m_slotById;
+
+    // IDs of removed points are handed out again, smallest first, before new ones above all the used IDs
+    std::pmr::vector<uint32_t> m_freeIds;
+    uint32_t m_nextId{1};
 };
 
 class SubListChunkData: public ChunkData
 {
 public:
-    SubListChunkData() = default;
-    SubListChunkData(uint32_t cuePointId, const std::string& label): m_cuePointId(cuePointId), m_label(label) {}
+    SubListChunkData(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : ChunkData("labl"_cc), m_label(resource) {}
+    SubListChunkData(uint32_t cuePointId, std::string_view label, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : ChunkData("labl"_cc), m_cuePointId(cuePointId), m_label(label, resource) {}
 
-    virtual const char* getId() const override { return "labl"; }
-    virtual uint32_t getDataSize() const override { return m_label.size() + 5; }
+    virtual uint64_t getDataSize() const override { return m_label.size() + 5; }
 
-    virtual void readDataFromBuffer(std::ifstream& is, int size);
-    virtual void writeDataToBuffer(std::ofstream& os) const;
+    virtual void readDataFromBuffer(ByteReader& buffer);
+    virtual void writeDataToBuffer(ByteWriter& buffer) const;
+
+    uint32_t getCuePointId() const { return m_cuePointId; }
+    std::string_view getLabel() const { return m_label; }
+    void setLabel(std::string_view label) { m_label = label; }
 
 private:
     uint32_t m_cuePointId;
-    std::string m_label;
+    std::pmr::string m_label;
 };
 
 
@@ -150,17 +314,88 @@ private:
 class ListChunkData: public ChunkData
 {
 public:
-    virtual const char* getId() const override;
-    virtual uint32_t getDataSize() const override;
+    ListChunkData(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : ChunkData("LIST"_cc), m_lst(resource) {}
+
+    // Kept up to date by every change to the sub-chunks, so it doesn't depend on their count
+    virtual uint64_t getDataSize() const override { return m_dataSize; }
+
+    virtual void readDataFromBuffer(ByteReader& buffer);
+    virtual void writeDataToBuffer(ByteWriter& buffer) const;
+
+    void addData(ChunkPtr data)
+    {
+        m_lst.emplace_back(std::move(data));
+        m_dataSize += m_lst.back().getDataSize();
+    }
 
-    virtual void readDataFromBuffer(std::ifstream& is, int size);
-    virtual void writeDataToBuffer(std::ofstream& os) const;
+    FourCC getTypeId() const { return m_typeId; }
+    const std::pmr::vector<ChunkObject>& getChunks() const { return m_lst; }
 
-    void addData(ChunkData* data)
+    // Texts of the labl sub-chunks by the cue point they belong to
+    std::unordered_map<uint32_t, std::string_view> getLabelsByCuePointId() const;
+
+    // Relabels the cue points that already have a labl sub-chunk and adds one for the others,
+    // looking the existing ones up in a single pass. On duplicate IDs the last label wins
+    void setLabels(const std::vector<std::pair<uint32_t, const std::string*>>& labels);
+
+    // Makes the labl sub-chunks match labels in one pass: the others are dropped, the missing ones are appended
+    // in the order of their IDs. Sub-chunks of other types are kept
+    void replaceLabels(const std::unordered_map<uint32_t, std::string>& labels);
+
+    void clear()
     {
-        m_lst.emplace_back(data);
+        m_lst.clear();
+        m_dataSize = sizeof(m_typeId);
     }
 private:
-    char m_typeId[4] = {'a','d','t','l'};
-    std::vector<ChunkObject> m_lst;
+    void relabel(SubListChunkData* label, std::string_view text);
+
+    // Sub-chunks are made in the same memory resource as the list
+    std::pmr::memory_resource* resource() const { return m_lst.get_allocator().resource(); }
+
+    FourCC m_typeId{"adtl"_cc};
+    std::pmr::vector<ChunkObject> m_lst;
+    uint32_t m_dataSize{sizeof(m_typeId)};
+};
+
+
+// The first chunk of an RF64/BW64 file: the 64 bit sizes of the file, of the audio data and of any other chunk
+// that outgrew 32 bits, whose headers only say oversizedChunkSize
+class DataSize64ChunkData: public ChunkData
+{
+public:
+    DataSize64ChunkData(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : ChunkData("ds64"_cc), m_table(resource) {}
+
+    virtual uint64_t getDataSize() const override { return 28 + m_table.size() * sizeof(TableEntry); }
+
+    virtual void readDataFromBuffer(ByteReader& buffer);
+    virtual void writeDataToBuffer(ByteWriter& buffer) const;
+
+    uint64_t getRiffSize() const { return m_riffSize; }
+    uint64_t getDataChunkSize() const { return m_dataChunkSize; }
+    uint64_t getSampleCount() const { return m_sampleCount; }
+
+    void setRiffSize(uint64_t size) { m_riffSize = size; }
+    void setDataChunkSize(uint64_t size) { m_dataChunkSize = size; }
+    void setSampleCount(uint64_t count) { m_sampleCount = count; }
+
+    // The real payload size of a chunk that says oversizedChunkSize in its header, that one if it's not known
+    uint64_t getChunkSize(FourCC id) const;
+
+    // Sizes of the chunks other than data that need 64 bits
+    void setChunkSizes(const std::vector<std::pair<FourCC, uint64_t>>& sizes);
+
+private:
+    struct TableEntry {
+        FourCC id;
+        LittleEndianInt64 size;
+    };
+    static_assert(sizeof(TableEntry) == 12, "TableEntry must match the file layout");
+
+    uint64_t m_riffSize{0};
+    uint64_t m_dataChunkSize{0};
+    uint64_t m_sampleCount{0};
+    std::pmr::vector<TableEntry> m_table;
 };
@@ -0,0 +1,124 @@
+#include "workstealingpool.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Which pool and queue the current thread works for, so tasks submitted from a task stay local
+    thread_local const WorkStealingPool* t_pool = nullptr;
+    thread_local unsigned t_queueIndex = 0;
+}
+
+WorkStealingPool::WorkStealingPool(unsigned threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    for (unsigned i = 0; i < threadCount; i++)
+    {
+        m_queues.emplace_back(new Queue);
+    }
+
+    for (unsigned i = 0; i < threadCount; i++)
+    {
+        m_threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_taskAvailable.notify_all();
+
+    for (std::thread& thread: m_threads)
+    {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::submit(Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        unsigned index = (t_pool == this) ? t_queueIndex : (m_nextQueue++ % m_queues.size());
+        m_pendingCount++;
+
+        Queue& queue = *m_queues[index];
+        std::lock_guard<std::mutex> queueLock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+        m_queuedCount++;
+    }
+    m_taskAvailable.notify_one();
+}
+
+void WorkStealingPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_allDone.wait(lock, [this] { return m_pendingCount == 0; });
+}
+
+void WorkStealingPool::workerLoop(unsigned index)
+{
+    t_pool = this;
+    t_queueIndex = index;
+
+    while (true)
+    {
+        Task task;
+
+        if (popTask(index, task))
+        {
+            task();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_pendingCount == 0)
+            {
+                m_allDone.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_taskAvailable.wait(lock, [this] { return m_stop || m_queuedCount > 0; });
+
+        if (m_stop && m_queuedCount == 0)
+        {
+            return;
+        }
+    }
+}
+
+bool WorkStealingPool::popTask(unsigned index, Task &task)
+{
+    {
+        Queue& own = *m_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            m_queuedCount--;
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < m_queues.size(); i++)
+    {
+        Queue& victim = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            m_queuedCount--;
+            return true;
+        }
+    }
+
+    return false;
+}
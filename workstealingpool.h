@@ -0,0 +1,57 @@
+#pragma once
+
+#include <functional>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// Runs tasks on a fixed set of worker threads. Every worker has its own queue: it takes the newest task
+// from its own queue and, when that runs dry, steals the oldest one from another worker. So a worker stuck
+// on one huge file doesn't hold up the tasks queued behind it while the other workers sit idle.
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void()>;
+
+    // 0 threads means one per core
+    explicit WorkStealingPool(unsigned threadCount = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Tasks may submit more tasks, those go to the queue of the worker that runs them
+    void submit(Task task);
+
+    // Blocks until every submitted task, including the ones submitted by tasks, has finished
+    void wait();
+
+    unsigned threadCount() const { return m_threads.size(); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(unsigned index);
+    bool popTask(unsigned index, Task& task);
+
+    // Popping and stealing lock only the queue they take from. m_queuedCount changes under the same lock
+    // as the queue, so it never counts a task that isn't in a queue
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_queuedCount{0};
+
+    // Submitting pushes while holding it, so a worker going to sleep can't miss a new task
+    std::mutex m_mutex;
+    std::condition_variable m_taskAvailable;
+    std::condition_variable m_allDone;
+    size_t m_pendingCount{0};
+    unsigned m_nextQueue{0};
+    bool m_stop{false};
+};